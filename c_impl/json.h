@@ -18,14 +18,40 @@
 //  JSON_GROWTH_FACTOR
 //  Default: 2
 //  The multiplier by which the internal hash map capacity increases, when it runs out of capacity. A good value is 1.5 - 2.
+//  The resulting capacity is rounded up to the next power of two.
 //
 //  JSON_MAX_LOAD_FACTOR
 //  Default: 0.7
-//  The precentage at which the internal hash map increases the bucket capacity
+//  The precentage of used slots (including deleted ones) at which the internal hash map increases its capacity. Has to be below 1.
 //
 //  JSON_INITIAL_BUCKET_SIZE
 //  Default: 16
-//  This is the Default size of a Bucket for a json_object. The larger the Bucket Size, the faster the access but higher Memory Use.
+//  This is the Default amount of slots for a json_object, once it became a hash map. It is rounded up to a power of two, which is at least 16.
+//  The larger the Bucket Size, the fewer rehashes but higher Memory Use.
+//
+//  JSON_SMALL_OBJECT_SIZE
+//  Default: 8
+//  A json_object with up to this many keys is stored as a flat array of entries and searched linearly, which is smaller and
+//  faster to create than a hash map. When a key is inserted past this size, the object is turned into a hash map.
+//  Set it to 0 to always use a hash map.
+//
+//  JSON_HASH(data, len)
+//  Default: json__hash(data, len)
+//  Hash function used for object keys, it gets a unsigned char const * and a size_t length and has to return a size_t.
+//  The default reads 8 bytes at a time and mixes them with multiplications, similar to xxhash.
+//
+//  JSON_MAX_DEPTH
+//  Default: 1024
+//  The maximum nesting of arrays and objects json_parse accepts. The parser is recursive, so this limits its stack usage.
+//
+//  JSON_PTHREADS
+//  Default: Not defined
+//  Define this to parse json_ndjson_parse with multiple threads. Includes pthread.h, you have to link with -pthread.
+//
+//  JSON_NO_SSE2
+//  Default: Not defined
+//  The internal hash map compares 16 control bytes at once with SSE2, if the target supports it.
+//  Define this to always use the portable byte by byte fallback.
 //
 //  JSON_{MALLOC,CALLOC,REALLOC,FREE}
 //  Defaults: stdlib.h
@@ -46,6 +72,19 @@
 // C11
 // JSON_STATIC_ASSERT(JSON_INITIAL_BUCKET_SIZE > 0, "JSON_INITIAL_BUCKET_SIZE has to be larger than 0");
 
+#ifndef JSON_SMALL_OBJECT_SIZE
+#define JSON_SMALL_OBJECT_SIZE 8
+#endif // JSON_SMALL_OBJECT_SIZE
+
+#ifndef JSON_HASH
+#define JSON_HASH(data, len) json__hash(data, len)
+#define JSON__DEFAULT_HASH
+#endif // JSON_HASH
+
+#ifndef JSON_MAX_DEPTH
+#define JSON_MAX_DEPTH 1024
+#endif // JSON_MAX_DEPTH
+
 #ifndef JSON_GROWTH_FACTOR
 #define JSON_GROWTH_FACTOR 2
 #endif // JSON_GROWTH_FACTOR
@@ -83,27 +122,49 @@
 #define JSON_ASSERT(condition, message) assert(condition && message)
 #endif // JSON_ASSERT 
 
+#ifdef JSON_PTHREADS
+#include <pthread.h>
+#endif // JSON_PTHREADS
+
+#if defined(__SSE2__) && !defined(JSON_NO_SSE2)
+#include <emmintrin.h>
+#define JSON__USE_SSE2
+#endif
+
 #include <stddef.h>
+// qsort, even if all allocation functions are replaced
+#include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <float.h>
 
 enum json_type {
     // Invalid json value, a zero constructed value is invalid
     JSON_INVALID,
     JSON_OBJECT,
     JSON_ARRAY,
+    // A number, that is not integral or does not fit into a 64 bit integer
     JSON_NUMBER,
     JSON_BOOLEAN,
     JSON_STRING,
     JSON_NULL,
+    // A integral number, that fits into a int64_t
+    JSON_INTEGER,
+    // A integral number larger than INT64_MAX, that fits into a uint64_t
+    JSON_UNSIGNED,
 };
 
 
 // array with len 0 do not have any heap memory, items will be set to NULL
+// Heap allocated items are preceded by a hidden header with their capacity and reference count, so they always have to be
+// allocated, resized and freed by the json_array_* functions. Items of your own, like in JSON_CREATE_ARRAY, can only be copied.
 struct json_array {
     size_t len;
     struct json_value *items;
 };
 
+// NOTE: The strings returned by json_string_view and json_key_table_intern are tagged in the highest bits of len,
+// use json_string_len to get their length. Strings from values, paths and the object iterator are never tagged.
 struct json_string {
     size_t len;
     unsigned char *data;
@@ -118,8 +179,7 @@ struct json_object {
 // NOTE: The content of json_object_iterator is internal, you should not use it.
 // WARN: Do not modify the object while iterating, some weird stuff can happen if you do.
 struct json_object_iterator {
-    size_t _bucket_index;
-    struct json__hash_map_entry *_current_entry;
+    size_t _index;
     struct json__hash_map *_hm;
 };
 
@@ -133,10 +193,14 @@ struct json_object_entry {
 
 struct json_value {
     enum json_type type;
+    // NOTE: Internal, JSON__VALUE_* flags
+    unsigned char _flags;
     // NOTE: JSON_NULL does not have any data.
     union json_data {
         bool boolean;
         double number;
+        int64_t integer;
+        uint64_t unsigned_integer;
         struct json_object object;
         struct json_array array;
         struct json_string string;
@@ -169,9 +233,11 @@ bool json_object_set(struct json_object *obj, struct json_string key, struct jso
 // Gets the value at the key.
 struct json_value json_object_get(struct json_object *obj, struct json_string key, bool *found);
 
-// Deletes key from the object
-// Returns true if the key was found, false if not
-bool json_object_del(struct json_object *obj, struct json_string key);
+// Deletes key from the object, found is set if the key was in it.
+// Returns false if there was an allocation error. That only happens if the object is shared (see json_value_share)
+// and copying it fails, the key stays in the object in that case.
+// NOTE: found has to be provided, if it null, an assertion will fail.
+bool json_object_del(struct json_object *obj, struct json_string key, bool *found);
 
 // WARN: Do not modify the object while iterating, some weird stuff can happen if you do.
 struct json_object_iterator json_object_iterator_create(struct json_object *obj);
@@ -204,7 +270,13 @@ struct json_value json_string_copyv(struct json_string str, bool *ok);
 // Do not use the str passed into this function, the returnec value has taken ownership of str
 struct json_value json_string_to_value(struct json_string str);
 
-#define JSON_STR(cstr) (struct json_string) { .data = (unsigned char *) cstr, .len = sizeof(cstr) / sizeof(cstr[0]) }
+// Creates a string that points to str, without copying it. Deleting the string does nothing, so str has to outlive it.
+// When used as a object key, the view is stored as is.
+struct json_string json_string_view(unsigned char *str, size_t len);
+struct json_value json_string_viewv(unsigned char *str, size_t len);
+
+// Only works with string literals, the null terminator is not part of the string
+#define JSON_STR(cstr) (struct json_string) { .data = (unsigned char *) cstr, .len = sizeof(cstr) / sizeof(cstr[0]) - 1 }
 
 //------------------------------
 // ARRAY PUBLIC API
@@ -223,7 +295,31 @@ struct json_value json_array_copyv(struct json_array arr, bool *ok);
 struct json_array json_array_concat(struct json_array left, struct json_array right, bool *ok);
 struct json_value json_array_concatv(struct json_array left, struct json_array right, bool *ok);
 
-// This macro allows for easy creation of a array's with values, because currently json_array's are immutable (100% not because I am lazy to implement the proper functions or something /s).
+// The amount of items allocated, use json_array_reserve to change it
+size_t json_array_cap(struct json_array arr);
+
+// Makes sure that at least additional more items fit into the array without allocating.
+// The capacity grows by JSON_GROWTH_FACTOR, so pushing n items one by one is amortized O(n).
+// Returns false if there was an allocation error or the size overflows, the array stays unchanged in that case.
+bool json_array_reserve(struct json_array *arr, size_t additional);
+
+// Appends value, the value will be owned by the array afterwards.
+// Returns false if there was an allocation error.
+bool json_array_push(struct json_array *arr, struct json_value value);
+
+// Inserts value before index, moving all later items back. index may be arr->len, which is the same as json_array_push.
+// Returns false if there was an allocation error.
+bool json_array_insert(struct json_array *arr, size_t index, struct json_value value);
+
+// Removes the item at index, moving all later items forward. The removed value is returned and owned by the caller.
+// If the array is shared (see json_value_share) and copying it fails, a JSON_INVALID value is returned and the array stays unchanged.
+struct json_value json_array_remove(struct json_array *arr, size_t index);
+
+// Removes the last item and returns it, the returned value is owned by the caller. The array may not be empty.
+// If the array is shared (see json_value_share) and copying it fails, a JSON_INVALID value is returned and the array stays unchanged.
+struct json_value json_array_pop(struct json_array *arr);
+
+// This macro allows for easy creation of a array's with values.
 #define JSON_CREATE_ARRAY(ok, ...) json_array_copy((struct json_array) { .items = (struct json_value[]){ __VA_ARGS__ }, .len = sizeof((struct json_value[]){ __VA_ARGS__ }) / sizeof(struct json_value) }, (ok))
 
 struct json_value json_null(void);
@@ -239,15 +335,240 @@ struct json_value json_boolean(bool value);
 // This function cannot fail
 struct json_value json_number(double value);
 // This function cannot fail
+struct json_value json_integer(int64_t value);
+// Creates a JSON_INTEGER if the value fits into it, JSON_UNSIGNED otherwise
+// This function cannot fail
+struct json_value json_unsigned(uint64_t value);
+// This function cannot fail
 struct json_value json_null(void);
 
+// Returns the value of a JSON_NUMBER, JSON_INTEGER or JSON_UNSIGNED as a double, integers may lose precision.
+// NOTE: ok has to be provided, if it null, an assertion will fail.
+double json_value_to_double(struct json_value value, bool *ok);
+
 struct json_value json_value_copy(struct json_value value, bool *ok);
 
+// Returns a new reference to value without copying it, objects and arrays are reference counted and shared by all references.
+// A shared object or array is copied the first time it is modified through one of its references, with json_object_set,
+// json_object_del or the json_array_* functions. Only the modified level is copied, the values in it stay shared.
+// Strings are copied, unless they are interned or views. Every reference has to be deleted with json_value_delete.
+// The reference counts are atomic with GCC and Clang, so references to the same value can be used by different threads.
+// WARN: Values returned by json_object_get and the iterator are borrowed from the object. Modifying them in place modifies
+// every reference, share them first and json_object_set them back instead.
+// NOTE: ok has to be provided, if it null, an assertion will fail.
+struct json_value json_value_share(struct json_value value, bool *ok);
+
 // Free
 void json_value_delete(struct json_value value);
 void json_object_delete(struct json_object object);
 void json_array_delete(struct json_array array);
+// Does nothing for interned strings and views, these are owned by their json_key_table or by the caller
 void json_string_delete(struct json_string string);
+// The length of the string, without the tag of views and interned strings
+size_t json_string_len(struct json_string string);
+
+//------------------------------
+// KEY TABLE PUBLIC API
+//------------------------------
+
+// A key table stores every distinct key once, use one per document. Interned keys remember their hash and
+// are not copied when used as a object key, so building many objects with the same keys only hashes and copies each key once.
+// WARN: All objects using keys of a key table have to be deleted before the key table.
+struct json_key_table {
+    // NOTE: Internal API, to access please use the public api functions
+    struct json__hash_map *_hm;
+};
+
+// NOTE: ok has to be provided, if it null, an assertion will fail.
+struct json_key_table json_key_table_create(bool *ok);
+
+// Returns the interned version of key. If the key is not in the table yet, it will be copied into it.
+// The returned string is owned by the table, deleting it does nothing. Its hash is stored in front of its data.
+// NOTE: ok has to be provided, if it null, an assertion will fail.
+struct json_string json_key_table_intern(struct json_key_table *table, struct json_string key, bool *ok);
+
+// Frees all the interned keys
+void json_key_table_delete(struct json_key_table table);
+
+//------------------------------
+// PARSER PUBLIC API
+//------------------------------
+
+enum json_parse_error {
+    JSON_PARSE_OK,
+    // A allocation failed
+    JSON_PARSE_OOM,
+    // The input is not valid json
+    JSON_PARSE_SYNTAX,
+    // The input is nested deeper than JSON_MAX_DEPTH
+    JSON_PARSE_TOO_DEEP,
+};
+
+enum json_parse_flags {
+    JSON_PARSE_DEFAULT = 0,
+    // Strings and keys are not copied, they are views into the input. Escape sequences are decoded in place, which modifies the input.
+    // WARN: The input has to stay alive and unchanged until the parsed value is deleted.
+    JSON_PARSE_IN_SITU = 1 << 0,
+};
+
+struct json_parse_options {
+    // A combination of enum json_parse_flags
+    unsigned flags;
+    // If not NULL, all object keys are interned into this table
+    struct json_key_table *keys;
+};
+
+struct json_parse_result {
+    // Only valid if error is JSON_PARSE_OK, has to be deleted with json_value_delete
+    struct json_value value;
+    enum json_parse_error error;
+    // The byte offset into the input, where the error was found
+    size_t offset;
+};
+
+// Parses exactly one json value, surrounded by optional whitespace.
+struct json_parse_result json_parse(unsigned char *input, size_t len, struct json_parse_options options);
+
+//------------------------------
+// PATH PUBLIC API
+//------------------------------
+
+// NOTE: The content of json_path_segment is internal, you should not use it.
+struct json_path_segment {
+    // The decoded reference token
+    struct json_string _key;
+    size_t _hash;
+    // The token as a array index, only valid if _is_index is true
+    size_t _index;
+    bool _is_index;
+};
+
+// A compiled JSON Pointer (RFC 6901). Compile the paths once and evaluate them as often as needed, the keys are not hashed again.
+struct json_path {
+    size_t len;
+    struct json_path_segment *segments;
+};
+
+// Compiles a JSON Pointer like "/a/b/3/c", "" is the whole document. "~0" and "~1" are decoded to "~" and "/".
+// Segments are looked up as keys in objects and as indices in arrays.
+// ok is set to false, if the pointer is invalid or an allocation failed.
+// NOTE: ok has to be provided, if it null, an assertion will fail.
+struct json_path json_path_compile(char const *pointer, bool *ok);
+
+// Returns the value at path inside of root, the value is still owned by root.
+// NOTE: found has to be provided, if it null, an assertion will fail.
+struct json_value json_path_eval(struct json_value root, struct json_path const *path, bool *found);
+
+void json_path_delete(struct json_path path);
+
+// A group of paths, that are evaluated together. Their common prefixes are found once by json_path_set_compile,
+// so json_path_set_eval walks every common prefix only once and does not allocate.
+// NOTE: The content of json_path_set is internal, you should not use it.
+// WARN: The paths have to stay alive as long as the set is used.
+struct json_path_set {
+    // The amount of paths in the set
+    size_t _count;
+    struct json__path_set_node *_nodes;
+    // The indices of the paths in the order of _nodes
+    size_t *_ends;
+};
+
+// ok is set to false, if an allocation failed.
+// NOTE: ok has to be provided, if it null, an assertion will fail.
+struct json_path_set json_path_set_compile(struct json_path const *paths, size_t count, bool *ok);
+
+// values[i] and found[i] are set like json_path_eval would for the i-th path passed to json_path_set_compile.
+void json_path_set_eval(struct json_value root, struct json_path_set const *set, struct json_value *values, bool *found);
+
+void json_path_set_delete(struct json_path_set set);
+
+//------------------------------
+// TAPE PUBLIC API
+//------------------------------
+
+// A tape is the result of a single structural pass over a document, with one entry per value and key.
+// No json_value is built while parsing, use json_node_value to build one for the parts that are actually needed.
+// Every object and array knows where it ends, so everything that is not looked at is skipped.
+// Escape sequences in strings are only fully checked when they are compared to a key or turned into a json_value.
+// WARN: The input has to stay alive and unchanged as long as the tape is used.
+
+// NOTE: The content of json_tape is internal, you should not use it.
+struct json_tape {
+    unsigned char *_input;
+    struct json__tape_entry *_entries;
+    size_t _len;
+    size_t _cap;
+};
+
+// A value inside of a tape. Nodes point to their tape, so the tape may not be moved while they are used.
+struct json_node {
+    struct json_tape *_tape;
+    size_t _index;
+};
+
+struct json_tape_result {
+    // Only valid if error is JSON_PARSE_OK, has to be deleted with json_tape_delete
+    struct json_tape tape;
+    enum json_parse_error error;
+    // The byte offset into the input, where the error was found
+    size_t offset;
+};
+
+struct json_tape_result json_tape_parse(unsigned char *input, size_t len);
+void json_tape_delete(struct json_tape tape);
+
+struct json_node json_tape_root(struct json_tape *tape);
+enum json_type json_node_type(struct json_node node);
+
+// Looks up key in a object node, if the key exists multiple times, the last one is returned like json_parse keeps it.
+// NOTE: found has to be provided, if it null, an assertion will fail.
+struct json_node json_node_get(struct json_node node, struct json_string key, bool *found);
+
+// Returns the item at index of a array node.
+// NOTE: found has to be provided, if it null, an assertion will fail.
+struct json_node json_node_at(struct json_node node, size_t index, bool *found);
+
+// Like json_path_eval, but on a tape
+// NOTE: found has to be provided, if it null, an assertion will fail.
+struct json_node json_node_path(struct json_node node, struct json_path const *path, bool *found);
+
+// Builds a json_value of the node and everything inside of it, the options are the same as for json_parse.
+// WARN: With JSON_PARSE_IN_SITU, escape sequences are decoded in place, so keys inside of node can not be looked up anymore afterwards.
+struct json_parse_result json_node_value(struct json_node node, struct json_parse_options options);
+
+//------------------------------
+// NDJSON PUBLIC API
+//------------------------------
+
+// Newline delimited json (JSON Lines), every non empty line is one record.
+// The input is split into chunks at line boundaries. With JSON_PTHREADS, the chunks are parsed by a pool of threads,
+// but the records are still passed to the callback in input order, from the calling thread.
+
+struct json_ndjson_record {
+    // The number of the record, empty lines are not counted
+    size_t index;
+    // The byte offset of the record in the input
+    size_t offset;
+    // The parsed record, result.offset is relative to the record. The value is owned by the callback.
+    struct json_parse_result result;
+};
+
+// Return false to stop parsing, the remaining records are deleted.
+typedef bool (*json_ndjson_callback)(void *user, struct json_ndjson_record *record);
+
+struct json_ndjson_options {
+    // The options for every record.
+    // NOTE: json_key_table is not thread safe, with keys the records are always parsed on the calling thread.
+    struct json_parse_options parse;
+    // Amount of threads, 0 and 1 parse on the calling thread. Ignored without JSON_PTHREADS.
+    size_t threads;
+    // Approximate size of a chunk in bytes, 0 uses 1 MiB
+    size_t chunk_size;
+};
+
+// Parses all records in the input, which can also be a memory mapped file.
+// Returns JSON_PARSE_OOM if an allocation or starting the threads failed, syntax errors are reported per record to the callback.
+enum json_parse_error json_ndjson_parse(unsigned char *input, size_t len, struct json_ndjson_options options, json_ndjson_callback callback, void *user);
 
 #ifdef JSON_IMPLEMENTATION
 
@@ -259,70 +580,112 @@ void json_string_delete(struct json_string string);
 // hash map
 static struct json__hash_map* json__hm_create(void);
 static void json__hm_delete(struct json__hash_map* map);
-static bool json__hash_map_insert(struct json__hash_map *hm, struct json_string key, struct json_value value);
+static struct json__hash_map_entry* json__hash_map_insert(struct json__hash_map *hm, struct json_string key, size_t hash, struct json_value value);
+static struct json__hash_map_entry* json__hash_map_find(struct json__hash_map *hm, struct json_string key, size_t hash);
 static struct json__hash_map_entry* json__hash_map_get(struct json__hash_map *hm, struct json_string key);
-static bool json__hash_map_grow(struct json__hash_map *hm);
-static double json__hash_map_load_factor(struct json__hash_map *hm);
+static bool json__hash_map_rehash(struct json__hash_map *hm, size_t new_cap);
+static bool json__hash_map_reserve_one(struct json__hash_map *hm);
+static bool json__hash_map_small_insert(struct json__hash_map *hm, struct json__hash_map_entry entry);
 static void json__hash_map_entry_delete(struct json__hash_map_entry* entry);
 static bool json__hash_map_set(struct json__hash_map *hm, struct json_string key, struct json_value value);
 static bool json__hash_map_delete(struct json__hash_map *hm, struct json_string key);
-static struct json__hash_map *json__hash_map_copy(struct json__hash_map *hm);
+static struct json__hash_map *json__hash_map_copy(struct json__hash_map *hm, bool share);
 
 // hash map entry
-static struct json__hash_map_entry json__hash_map_entry_copy(struct json__hash_map_entry entry, struct json__hash_map_entry *new_collisions, struct json__hash_map_entry *old_collisions, bool *ok);
-static bool json__hash_map_entry_valid(struct json__hash_map_entry *entry);
+static struct json__hash_map_entry json__hash_map_entry_copy(struct json__hash_map_entry entry, bool share, bool *ok);
+static bool json__hash_map_slot_full(struct json__hash_map *hm, size_t index);
+
+// array
+static struct json_array json__array_copy_deep(struct json_array arr, bool *ok);
+static struct json_value *json__array_realloc(struct json_value *items, size_t cap);
+static bool json__array_make_unique(struct json_array *arr);
+
+// object
+static bool json__object_make_unique(struct json_object *obj);
 
 // string
 static bool json__string_eq(struct json_string first, struct json_string second);
+static size_t json__string_hash(struct json_string str);
+static struct json_string json__string_copy_key(struct json_string str, bool *ok);
+
+// Tags in the highest bits of json_string.len, no string can be that long
+// The data is owned by someone else, see json_string_view
+#define JSON__STRING_BORROWED (SIZE_MAX ^ (SIZE_MAX >> 1))
+// The data is owned by a json_key_table and preceded by its hash
+#define JSON__STRING_INTERNED (JSON__STRING_BORROWED >> 1)
+#define JSON__STRING_TAGS (JSON__STRING_BORROWED | JSON__STRING_INTERNED)
+
+// The value is a string, that was tagged with JSON__STRING_TAGS. It is not deleted with the value.
+#define JSON__VALUE_BORROWED ((unsigned char) 1)
+
+// Reference counts of shared objects and arrays, see json_value_share. JSON__REF_DEC returns the new count.
+#if defined(__GNUC__) || defined(__clang__)
+#define JSON__REF_LOAD(refs) __atomic_load_n((refs), __ATOMIC_ACQUIRE)
+#define JSON__REF_INC(refs) ((void) __atomic_add_fetch((refs), 1, __ATOMIC_RELAXED))
+#define JSON__REF_DEC(refs) __atomic_sub_fetch((refs), 1, __ATOMIC_ACQ_REL)
+#else
+#define JSON__REF_LOAD(refs) (*(refs))
+#define JSON__REF_INC(refs) ((void) (*(refs) += 1))
+#define JSON__REF_DEC(refs) (*(refs) -= 1)
+#endif
+
+// Heap allocated array items are preceded by this hidden header
+struct json__array_header {
+    // The number of json_array references to the items, see json_value_share
+    size_t refs;
+    // The amount of items allocated
+    size_t cap;
+};
+
+#define JSON__ARRAY_HEADER(items) ((struct json__array_header *)(void *)(items) - 1)
+#define JSON__ARRAY_REFS(items) (&JSON__ARRAY_HEADER(items)->refs)
 
 // Internal Hash Map for strings to json_value
+// Small maps (see JSON_SMALL_OBJECT_SIZE) have no control bytes, their first size entries are used in insertion order.
+// Otherwise this is a open addressing hash map. Slots are grouped into groups of JSON__GROUP_WIDTH, every slot has a control byte,
+// which is either JSON__CTRL_EMPTY, JSON__CTRL_DELETED or the lower 7 bits of the hash of the key in the slot.
+// A lookup compares a whole group of control bytes at once and only looks at the entries whose control byte matches.
 struct json__hash_map {
-    struct json__hash_map_entry *bucket;
-    size_t bucket_size;
-    size_t bucket_cap;
-
-    // This is a linked list
-    struct json__hash_map_entry *collisions;
-    size_t collisions_size;
-    size_t collisions_cap;
+    // cap control bytes, NULL while the map is small
+    unsigned char *ctrl;
+    // cap entries, only the ones with a full control byte are initialized
+    struct json__hash_map_entry *entries;
+    // A power of two and a multiple of JSON__GROUP_WIDTH, if the map is not small
+    size_t cap;
+    size_t size;
+    size_t tombstones;
+    // The number of json_object references to this map, see json_value_share
+    size_t refs;
 };
 
 struct json__hash_map_entry {
     struct json_string key;
+    // The full hash of key, checked before the key is compared
+    size_t hash;
     struct json_value value;
-    struct json__hash_map_entry* next;
 };
 
 
-
 //------------------------------
 // PUBLIC API IMPL
 //------------------------------
 
 struct json_object_iterator json_object_iterator_create(struct json_object *obj) {
     return (struct json_object_iterator) {
-        ._bucket_index = 0,
-        ._current_entry = NULL,
+        ._index = 0,
         ._hm = obj->_hm,
     };
 }
 
 struct json_object_entry json_object_iterator_next(struct json_object_iterator* iterator) {
-    if (iterator->_current_entry && iterator->_current_entry->next) {
-        iterator->_current_entry = iterator->_current_entry->next;
-        return (struct json_object_entry) {
-            .value = &iterator->_current_entry->value,
-            .key = iterator->_current_entry->key,
-            .found = true,
-        };
-    }
-
-    for (size_t i = iterator->_bucket_index; i < iterator->_hm->bucket_cap; i++) {
-        iterator->_current_entry = &iterator->_hm->bucket[iterator->_bucket_index];
-        if (json__hash_map_entry_valid(iterator->_current_entry)) {
+    while (iterator->_index < iterator->_hm->cap) {
+        size_t index = iterator->_index;
+        iterator->_index += 1;
+        if (json__hash_map_slot_full(iterator->_hm, index)) {
+            struct json__hash_map_entry *entry = &iterator->_hm->entries[index];
             return (struct json_object_entry) {
-                .value = &iterator->_current_entry->value,
-                .key = iterator->_current_entry->key,
+                .value = &entry->value,
+                .key = { .len = json_string_len(entry->key), .data = entry->key.data },
                 .found = true,
             };
         }
@@ -391,23 +754,40 @@ struct json_value json_string_create_cstrv(char *str, bool *ok) {
 // The string has to be longer than 0
 // Returns an empty string with NULL as data when the allocation fails
 struct json_string json_string_copy(struct json_string str, bool *ok) {
-    return json_string_create(str.data, str.len, ok);
+    return json_string_create(str.data, json_string_len(str), ok);
 }
 
 // NOTE: Copies the string
 // The string has to be longer than 0
 // Returns an empty string with NULL as data when the allocation fails
 struct json_value json_string_copyv(struct json_string str, bool *ok) {
-    return json_string_to_value(json_string_create(str.data, str.len, ok));
+    return json_string_to_value(json_string_copy(str, ok));
 }
 
+// The tag of views and interned strings moves into the value, so that the string in it has its real length
 struct json_value json_string_to_value(struct json_string str) {
     return (struct json_value) {
         .type = JSON_STRING,
-        .data.string = str,
+        ._flags = (str.len & JSON__STRING_TAGS) != 0 ? JSON__VALUE_BORROWED : 0,
+        .data.string = { .len = json_string_len(str), .data = str.data },
+    };
+}
+
+struct json_string json_string_view(unsigned char *str, size_t len) {
+    return (struct json_string) {
+        .data = str,
+        .len = len | JSON__STRING_BORROWED,
     };
 }
 
+size_t json_string_len(struct json_string string) {
+    return string.len & ~JSON__STRING_TAGS;
+}
+
+struct json_value json_string_viewv(unsigned char *str, size_t len) {
+    return json_string_to_value(json_string_view(str, len));
+}
+
 // Create object
 
 // Allocates a new object, use the other json_object_* functions to add and remove attributes.
@@ -435,7 +815,7 @@ struct json_value json_object_to_value(struct json_object obj) {
 struct json_object json_object_copy(struct json_object obj, bool *ok) {
     assert(ok != NULL);
     struct json_object new_obj = {
-        ._hm = json__hash_map_copy(obj._hm),
+        ._hm = json__hash_map_copy(obj._hm, false),
     };
 
     if (new_obj._hm == NULL) {
@@ -451,13 +831,27 @@ struct json_value json_object_copyv(struct json_object obj, bool *ok) {
     return json_object_to_value(json_object_copy(obj, ok));
 }
 
-bool json_object_set(struct json_object *obj, struct json_string key, struct json_value value) {
-    if (json__hash_map_set(obj->_hm, key, value)) {
+// Gives obj its own hash map, if the current one is shared with other references. The values in it stay shared.
+// Returns false on a allocation failiure, obj stays unchanged in that case.
+static bool json__object_make_unique(struct json_object *obj) {
+    if (JSON__REF_LOAD(&obj->_hm->refs) == 1) {
         return true;
     }
 
-    // Insert if it does not exist.
-    return json__hash_map_insert(obj->_hm, key, value);
+    struct json__hash_map *hm = json__hash_map_copy(obj->_hm, true);
+    if (hm == NULL) {
+        return false;
+    }
+    json_object_delete(*obj);
+    obj->_hm = hm;
+    return true;
+}
+
+bool json_object_set(struct json_object *obj, struct json_string key, struct json_value value) {
+    if (!json__object_make_unique(obj)) {
+        return false;
+    }
+    return json__hash_map_set(obj->_hm, key, value);
 }
 
 // Gets the value at the key.
@@ -471,8 +865,18 @@ struct json_value json_object_get(struct json_object *obj, struct json_string ke
     return entry->value;
 }
 
-bool json_object_del(struct json_object *obj, struct json_string key) {
-    return json__hash_map_delete(obj->_hm, key);
+bool json_object_del(struct json_object *obj, struct json_string key, bool *found) {
+    assert(found != NULL);
+    // Only copy a shared map, if there is something to delete
+    *found = json__hash_map_get(obj->_hm, key) != NULL;
+    if (!*found) {
+        return true;
+    }
+    if (!json__object_make_unique(obj)) {
+        return false;
+    }
+    json__hash_map_delete(obj->_hm, key);
+    return true;
 }
 
 // Create array
@@ -485,10 +889,150 @@ struct json_array json_array_create(void) {
     };
 }
 
+// Reallocates items, including the hidden header in front of them. A new allocation starts with one reference.
+// Returns NULL on a allocation failiure or if the size overflows, items stays valid in that case.
+static struct json_value *json__array_realloc(struct json_value *items, size_t cap) {
+    if (cap > (SIZE_MAX - sizeof(struct json__array_header)) / sizeof(*items)) {
+        return NULL;
+    }
+    struct json__array_header *header = JSON_REALLOC(items == NULL ? NULL : JSON__ARRAY_HEADER(items), sizeof(*header) + cap * sizeof(*items));
+    if (header == NULL) {
+        return NULL;
+    }
+    if (items == NULL) {
+        header->refs = 1;
+    }
+    header->cap = cap;
+    return (struct json_value *)(void *)(header + 1);
+}
+
+size_t json_array_cap(struct json_array arr) {
+    return arr.items == NULL ? 0 : JSON__ARRAY_HEADER(arr.items)->cap;
+}
+
+// Gives arr its own items, if the current ones are shared with other references. The values in them stay shared.
+// Returns false on a allocation failiure, arr stays unchanged in that case.
+static bool json__array_make_unique(struct json_array *arr) {
+    if (arr->items == NULL || JSON__REF_LOAD(JSON__ARRAY_REFS(arr->items)) == 1) {
+        return true;
+    }
+
+    struct json_value *items = json__array_realloc(NULL, json_array_cap(*arr));
+    if (items == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < arr->len; i++) {
+        bool ok = true;
+        items[i] = json_value_share(arr->items[i], &ok);
+        if (!ok) {
+            json_array_delete((struct json_array) { .len = i, .items = items });
+            return false;
+        }
+    }
+    json_array_delete(*arr);
+    arr->items = items;
+    return true;
+}
+
+bool json_array_reserve(struct json_array *arr, size_t additional) {
+    if (additional > SIZE_MAX - arr->len || !json__array_make_unique(arr)) {
+        return false;
+    }
+
+    size_t cap = json_array_cap(*arr);
+    size_t needed = arr->len + additional;
+    if (needed <= cap) {
+        return true;
+    }
+
+    // Converting a double that does not fit into a size_t is undefined
+    double grown = (double)cap * JSON_GROWTH_FACTOR;
+    size_t new_cap = grown < (double)SIZE_MAX ? (size_t)grown : SIZE_MAX;
+    if (new_cap < 4) {
+        new_cap = 4;
+    }
+    if (new_cap < needed) {
+        new_cap = needed;
+    }
+
+    struct json_value *items = json__array_realloc(arr->items, new_cap);
+    if (items == NULL) {
+        return false;
+    }
+    arr->items = items;
+    return true;
+}
+
+bool json_array_push(struct json_array *arr, struct json_value value) {
+    if (!json_array_reserve(arr, 1)) {
+        return false;
+    }
+    arr->items[arr->len] = value;
+    arr->len += 1;
+    return true;
+}
+
+bool json_array_insert(struct json_array *arr, size_t index, struct json_value value) {
+    JSON_ASSERT(index <= arr->len, "json_array_insert index out of bounds");
+    if (!json_array_reserve(arr, 1)) {
+        return false;
+    }
+    memmove(&arr->items[index + 1], &arr->items[index], (arr->len - index) * sizeof(*arr->items));
+    arr->items[index] = value;
+    arr->len += 1;
+    return true;
+}
+
+struct json_value json_array_remove(struct json_array *arr, size_t index) {
+    JSON_ASSERT(index < arr->len, "json_array_remove index out of bounds");
+    if (!json__array_make_unique(arr)) {
+        return (struct json_value) {0};
+    }
+    struct json_value value = arr->items[index];
+    memmove(&arr->items[index], &arr->items[index + 1], (arr->len - index - 1) * sizeof(*arr->items));
+    arr->len -= 1;
+    return value;
+}
+
+struct json_value json_array_pop(struct json_array *arr) {
+    JSON_ASSERT(arr->len > 0, "json_array_pop on a empty array");
+    if (!json__array_make_unique(arr)) {
+        return (struct json_value) {0};
+    }
+    arr->len -= 1;
+    return arr->items[arr->len];
+}
+
+// Unlike json_array_copy, this also copies the items themselves
+static struct json_array json__array_copy_deep(struct json_array arr, bool *ok) {
+    struct json_array new_arr = json_array_create();
+    if (!json_array_reserve(&new_arr, arr.len)) {
+        *ok = false;
+        return new_arr;
+    }
+
+    for (size_t i = 0; i < arr.len; i++) {
+        new_arr.items[i] = json_value_copy(arr.items[i], ok);
+        if (!*ok) {
+            json_array_delete(new_arr);
+            return json_array_create();
+        }
+        new_arr.len += 1;
+    }
+
+    *ok = true;
+    return new_arr;
+}
+
 // Allocates a new array and copies both left and right into it
 // If the left.len + right.len > 0 and the return.items == NULL. Then the allocation failed. When a allocation fails, the returned array will have a length of 0.
 struct json_array json_array_concat(struct json_array left, struct json_array right, bool *ok) {
-    struct json_value *new_items = JSON_MALLOC(sizeof(*new_items) * (left.len + right.len));
+    if (left.len + right.len == 0) {
+        *ok = true;
+        return json_array_create();
+    }
+
+    struct json_value *new_items = json__array_realloc(NULL, left.len + right.len);
     if (new_items == NULL) {
         *ok = false;
         return json_array_create();
@@ -517,8 +1061,12 @@ struct json_value json_array_concatv(struct json_array left, struct json_array r
 // Allocates a new array and copies the elements over, mostly for a utility macro
 // If the arr.len > 0 and the return.items == NULL. Then the allocation failed. When a allocation fails, the returned array will have a length of 0.
 struct json_array json_array_copy(struct json_array arr, bool *ok) {
-    struct json_value *items = JSON_MALLOC(arr.len * sizeof(*items));
+    if (arr.len == 0) {
+        *ok = true;
+        return json_array_create();
+    }
 
+    struct json_value *items = json__array_realloc(NULL, arr.len);
 
     if (items == NULL) {
         *ok = false;
@@ -564,27 +1112,94 @@ struct json_value json_number(double value) {
     };
 }
 
+struct json_value json_integer(int64_t value) {
+    return (struct json_value) {
+        .type = JSON_INTEGER,
+        .data.integer = value,
+    };
+}
+
+struct json_value json_unsigned(uint64_t value) {
+    if (value <= INT64_MAX) {
+        return json_integer((int64_t) value);
+    }
+    return (struct json_value) {
+        .type = JSON_UNSIGNED,
+        .data.unsigned_integer = value,
+    };
+}
+
 struct json_value json_null(void) {
     return (struct json_value) {
         .type = JSON_NULL,
     };
 }
 
+double json_value_to_double(struct json_value value, bool *ok) {
+    assert(ok != NULL);
+    *ok = true;
+    switch (value.type) {
+        case JSON_NUMBER:
+            return value.data.number;
+        case JSON_INTEGER:
+            return (double) value.data.integer;
+        case JSON_UNSIGNED:
+            return (double) value.data.unsigned_integer;
+        default:
+            *ok = false;
+            return 0;
+    }
+}
+
 struct json_value json_value_copy(struct json_value value, bool *ok) {
     assert(ok != NULL);
     switch (value.type) {
         case JSON_OBJECT:
             return json_object_copyv(value.data.object, ok);
         case JSON_ARRAY:
-            return json_array_copyv(value.data.array, ok);
+            return json_array_to_value(json__array_copy_deep(value.data.array, ok));
         case JSON_STRING:
             return json_string_copyv(value.data.string, ok);
         case JSON_NUMBER:
+        case JSON_INTEGER:
+        case JSON_UNSIGNED:
         case JSON_BOOLEAN:
         case JSON_NULL:
         case JSON_INVALID:
-            return value;
+            break;
+    }
+    *ok = true;
+    return value;
+}
+
+struct json_value json_value_share(struct json_value value, bool *ok) {
+    assert(ok != NULL);
+    switch (value.type) {
+        case JSON_OBJECT:
+            if (value.data.object._hm != NULL) {
+                JSON__REF_INC(&value.data.object._hm->refs);
+            }
+            break;
+        case JSON_ARRAY:
+            if (value.data.array.items != NULL) {
+                JSON__REF_INC(JSON__ARRAY_REFS(value.data.array.items));
+            }
+            break;
+        case JSON_STRING:
+            if ((value._flags & JSON__VALUE_BORROWED) == 0) {
+                return json_string_copyv(value.data.string, ok);
+            }
+            break;
+        case JSON_NUMBER:
+        case JSON_INTEGER:
+        case JSON_UNSIGNED:
+        case JSON_BOOLEAN:
+        case JSON_NULL:
+        case JSON_INVALID:
+            break;
     }
+    *ok = true;
+    return value;
 }
 
 void json_value_delete(struct json_value value) {
@@ -596,9 +1211,13 @@ void json_value_delete(struct json_value value) {
             json_array_delete(value.data.array);
             break;
         case JSON_STRING:
-            json_string_delete(value.data.string);
+            if ((value._flags & JSON__VALUE_BORROWED) == 0) {
+                json_string_delete(value.data.string);
+            }
             break;
         case JSON_NUMBER:
+        case JSON_INTEGER:
+        case JSON_UNSIGNED:
         case JSON_BOOLEAN:
         case JSON_NULL:
         case JSON_INVALID:
@@ -606,210 +1225,2179 @@ void json_value_delete(struct json_value value) {
     }
 }
 
-void json_object_delete(struct json_object object) {}
+void json_object_delete(struct json_object object) {
+    if (object._hm != NULL && JSON__REF_DEC(&object._hm->refs) == 0) {
+        json__hm_delete(object._hm);
+    }
+}
 
 void json_array_delete(struct json_array array) {
+    if (array.items == NULL || JSON__REF_DEC(JSON__ARRAY_REFS(array.items)) > 0) {
+        return;
+    }
     for (size_t i = 0; i < array.len; i++) {
         json_value_delete(array.items[i]);
     }
-    JSON_FREE(array.items);
+    JSON_FREE(JSON__ARRAY_HEADER(array.items));
 }
 
 void json_string_delete(struct json_string string) {
-    if (0 < string.len) {
+    if (0 < string.len && (string.len & JSON__STRING_TAGS) == 0) {
         JSON_FREE(string.data);
     }
 }
 
-//------------------------------
-// INTERNAL HASH MAP FACILITIES
-//------------------------------
-
-// Generate a hash value
-static size_t json__hash(unsigned char const * str, size_t len) {
-    size_t hash = 5381;
-
-    for (size_t i = 0; i < len; i++) {
-        hash = hash * 33 ^ str[i];
-    }
+// Key table
 
-    return hash;
+struct json_key_table json_key_table_create(bool *ok) {
+    assert(ok != NULL);
+    struct json__hash_map *hm = json__hm_create();
+    *ok = hm != NULL;
+    return (struct json_key_table) {
+        ._hm = hm,
+    };
 }
 
-// Returns NULL if an allocation failed
-static struct json__hash_map* json__hm_create(void) {
-    struct json__hash_map* ptr = JSON_MALLOC(sizeof(*ptr));
-    if (ptr == NULL) {
-        return NULL;
+struct json_string json_key_table_intern(struct json_key_table *table, struct json_string key, bool *ok) {
+    assert(ok != NULL);
+    size_t hash = json__string_hash(key);
+    struct json__hash_map_entry *entry = json__hash_map_find(table->_hm, key, hash);
+    if (entry != NULL) {
+        *ok = true;
+        return entry->key;
     }
 
-    struct json__hash_map_entry *bucket = JSON_CALLOC(JSON_INITIAL_BUCKET_SIZE, sizeof(*bucket));
-    if (bucket == NULL) {
-        return NULL;
+    // The table has to own its copy, even if key is interned in some other table. The hash is stored in front of it.
+    size_t len = json_string_len(key);
+    unsigned char *data = JSON_MALLOC(sizeof(hash) + len);
+    if (data == NULL) {
+        *ok = false;
+        return json_string_create_empty();
+    }
+    memcpy(data, &hash, sizeof(hash));
+    if (len > 0) {
+        memcpy(data + sizeof(hash), key.data, len);
+    }
+
+    struct json_string interned = {
+        .len = len | JSON__STRING_INTERNED,
+        .data = data + sizeof(hash),
+    };
+    if (json__hash_map_insert(table->_hm, interned, hash, json_null()) == NULL) {
+        JSON_FREE(data);
+        *ok = false;
+        return json_string_create_empty();
+    }
+    *ok = true;
+    return interned;
+}
+
+void json_key_table_delete(struct json_key_table table) {
+    if (table._hm == NULL) {
+        return;
+    }
+    // Deleting the map does not free the interned keys
+    for (size_t i = 0; i < table._hm->cap; i++) {
+        if (json__hash_map_slot_full(table._hm, i)) {
+            JSON_FREE(table._hm->entries[i].key.data - sizeof(size_t));
+        }
+    }
+    json__hm_delete(table._hm);
+}
+
+//------------------------------
+// PARSER IMPL
+//------------------------------
+
+struct json__parser {
+    unsigned char *input;
+    size_t len;
+    size_t pos;
+    size_t depth;
+    struct json_parse_options options;
+    enum json_parse_error error;
+};
+
+static bool json__parse_value(struct json__parser *p, struct json_value *out);
+
+// Sets the error, if there is none yet. Always returns false.
+static bool json__parse_fail(struct json__parser *p, enum json_parse_error error) {
+    if (p->error == JSON_PARSE_OK) {
+        p->error = error;
+    }
+    return false;
+}
+
+static void json__parse_skip_whitespace(struct json__parser *p) {
+    while (p->pos < p->len) {
+        unsigned char c = p->input[p->pos];
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+            return;
+        }
+        p->pos += 1;
+    }
+}
+
+static bool json__parse_literal(struct json__parser *p, char const *literal, size_t len) {
+    if (p->len - p->pos < len || memcmp(&p->input[p->pos], literal, len) != 0) {
+        return json__parse_fail(p, JSON_PARSE_SYNTAX);
+    }
+    p->pos += len;
+    return true;
+}
+
+static int json__hex_digit(unsigned char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// Reads the 4 hex digits of a \u escape at src, returns -1 if they are invalid
+static long json__parse_hex4(unsigned char const *src) {
+    long value = 0;
+    for (int i = 0; i < 4; i++) {
+        int digit = json__hex_digit(src[i]);
+        if (digit < 0) {
+            return -1;
+        }
+        value = value * 16 + digit;
+    }
+    return value;
+}
+
+static size_t json__utf8_encode(unsigned char *dst, unsigned long codepoint) {
+    if (codepoint < 0x80) {
+        dst[0] = (unsigned char) codepoint;
+        return 1;
+    }
+    if (codepoint < 0x800) {
+        dst[0] = (unsigned char)(0xC0 | (codepoint >> 6));
+        dst[1] = (unsigned char)(0x80 | (codepoint & 0x3F));
+        return 2;
+    }
+    if (codepoint < 0x10000) {
+        dst[0] = (unsigned char)(0xE0 | (codepoint >> 12));
+        dst[1] = (unsigned char)(0x80 | ((codepoint >> 6) & 0x3F));
+        dst[2] = (unsigned char)(0x80 | (codepoint & 0x3F));
+        return 3;
+    }
+    dst[0] = (unsigned char)(0xF0 | (codepoint >> 18));
+    dst[1] = (unsigned char)(0x80 | ((codepoint >> 12) & 0x3F));
+    dst[2] = (unsigned char)(0x80 | ((codepoint >> 6) & 0x3F));
+    dst[3] = (unsigned char)(0x80 | (codepoint & 0x3F));
+    return 4;
+}
+
+// Decodes the escape sequences of src into dst. The decoded string is never longer than src, so dst may be equal to src.
+// The escapes have already been checked by json__parse_string_span, except for the \u ones.
+// Returns the decoded length or (size_t)-1 if a \u escape is invalid.
+static size_t json__unescape(unsigned char *dst, unsigned char const *src, size_t len) {
+    size_t out = 0;
+    size_t i = 0;
+    while (i < len) {
+        if (src[i] != '\\') {
+            dst[out++] = src[i++];
+            continue;
+        }
+
+        unsigned char c = src[i + 1];
+        i += 2;
+        switch (c) {
+            case '"': dst[out++] = '"'; break;
+            case '\\': dst[out++] = '\\'; break;
+            case '/': dst[out++] = '/'; break;
+            case 'b': dst[out++] = '\b'; break;
+            case 'f': dst[out++] = '\f'; break;
+            case 'n': dst[out++] = '\n'; break;
+            case 'r': dst[out++] = '\r'; break;
+            case 't': dst[out++] = '\t'; break;
+            case 'u': {
+                if (len - i < 4) {
+                    return (size_t)-1;
+                }
+                long codepoint = json__parse_hex4(&src[i]);
+                if (codepoint < 0) {
+                    return (size_t)-1;
+                }
+                i += 4;
+
+                if (codepoint >= 0xD800 && codepoint <= 0xDBFF) {
+                    // High surrogate, has to be followed by a low surrogate
+                    if (len - i < 6 || src[i] != '\\' || src[i + 1] != 'u') {
+                        return (size_t)-1;
+                    }
+                    long low = json__parse_hex4(&src[i + 2]);
+                    if (low < 0xDC00 || low > 0xDFFF) {
+                        return (size_t)-1;
+                    }
+                    i += 6;
+                    codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+                } else if (codepoint >= 0xDC00 && codepoint <= 0xDFFF) {
+                    return (size_t)-1;
+                }
+
+                out += json__utf8_encode(&dst[out], (unsigned long) codepoint);
+                break;
+            }
+        }
+    }
+    return out;
+}
+
+// Finds the end of the string starting after the opening quote at p->pos and moves p->pos behind the closing quote.
+// Sets *raw_len to the length of the raw contents and *escaped, if they contain any escape sequences.
+static bool json__parse_string_span(struct json__parser *p, size_t *raw_len, bool *escaped) {
+    size_t start = p->pos;
+    *escaped = false;
+    while (p->pos < p->len) {
+        unsigned char c = p->input[p->pos];
+        if (c == '"') {
+            *raw_len = p->pos - start;
+            p->pos += 1;
+            return true;
+        }
+        if (c < 0x20) {
+            return json__parse_fail(p, JSON_PARSE_SYNTAX);
+        }
+        if (c == '\\') {
+            if (p->pos + 1 >= p->len || p->input[p->pos + 1] == '\0' || strchr("\"\\/bfnrtu", p->input[p->pos + 1]) == NULL) {
+                return json__parse_fail(p, JSON_PARSE_SYNTAX);
+            }
+            *escaped = true;
+            p->pos += 2;
+            continue;
+        }
+        p->pos += 1;
+    }
+    return json__parse_fail(p, JSON_PARSE_SYNTAX);
+}
+
+// Parses a string, p->pos has to be at the opening quote.
+// If temporary is set, the string is only used until the next call into the parser and it will not be deleted,
+// so a view into the input is returned whenever possible. Otherwise the string is owned, unless JSON_PARSE_IN_SITU is used.
+// If *allocated is set afterwards, the string has to be deleted by the caller.
+static bool json__parse_string(struct json__parser *p, struct json_string *out, bool temporary, bool *allocated) {
+    p->pos += 1;
+    size_t start = p->pos;
+    size_t raw_len;
+    bool escaped;
+    *allocated = false;
+    if (!json__parse_string_span(p, &raw_len, &escaped)) {
+        return false;
+    }
+
+    unsigned char *raw = &p->input[start];
+    bool in_situ = (p->options.flags & JSON_PARSE_IN_SITU) != 0;
+
+    if (raw_len == 0) {
+        *out = json_string_create_empty();
+        return true;
+    }
+
+    if (in_situ || (temporary && !escaped)) {
+        size_t len = raw_len;
+        if (escaped) {
+            len = json__unescape(raw, raw, raw_len);
+            if (len == (size_t)-1) {
+                p->pos = start;
+                return json__parse_fail(p, JSON_PARSE_SYNTAX);
+            }
+        }
+        *out = in_situ ? json_string_view(raw, len) : (struct json_string) { .data = raw, .len = len };
+        return true;
+    }
+
+    if (!escaped) {
+        bool ok;
+        *out = json_string_create(raw, raw_len, &ok);
+        *allocated = ok;
+        return ok ? true : json__parse_fail(p, JSON_PARSE_OOM);
+    }
+
+    unsigned char *data = JSON_MALLOC(raw_len);
+    if (data == NULL) {
+        return json__parse_fail(p, JSON_PARSE_OOM);
+    }
+    size_t len = json__unescape(data, raw, raw_len);
+    if (len == (size_t)-1) {
+        JSON_FREE(data);
+        p->pos = start;
+        return json__parse_fail(p, JSON_PARSE_SYNTAX);
+    }
+    *out = (struct json_string) {
+        .data = data,
+        .len = len,
+    };
+    *allocated = true;
+    return true;
+}
+
+// Checks the number grammar and moves p->pos behind the number, without converting it
+static bool json__scan_number(struct json__parser *p) {
+    unsigned char *s = p->input;
+    size_t i = p->pos;
+
+    if (i < p->len && s[i] == '-') {
+        i += 1;
+    }
+    if (i >= p->len) {
+        return json__parse_fail(p, JSON_PARSE_SYNTAX);
+    }
+    if (s[i] == '0') {
+        i += 1;
+    } else if (s[i] >= '1' && s[i] <= '9') {
+        while (i < p->len && s[i] >= '0' && s[i] <= '9') {
+            i += 1;
+        }
+    } else {
+        return json__parse_fail(p, JSON_PARSE_SYNTAX);
+    }
+
+    if (i < p->len && s[i] == '.') {
+        i += 1;
+        if (i >= p->len || s[i] < '0' || s[i] > '9') {
+            p->pos = i;
+            return json__parse_fail(p, JSON_PARSE_SYNTAX);
+        }
+        while (i < p->len && s[i] >= '0' && s[i] <= '9') {
+            i += 1;
+        }
+    }
+
+    if (i < p->len && (s[i] == 'e' || s[i] == 'E')) {
+        i += 1;
+        if (i < p->len && (s[i] == '+' || s[i] == '-')) {
+            i += 1;
+        }
+        if (i >= p->len || s[i] < '0' || s[i] > '9') {
+            p->pos = i;
+            return json__parse_fail(p, JSON_PARSE_SYNTAX);
+        }
+        while (i < p->len && s[i] >= '0' && s[i] <= '9') {
+            i += 1;
+        }
+    }
+
+    p->pos = i;
+    return true;
+}
+
+// All powers of ten, which are exactly representable as a double
+static double const json__exact_powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// Converts a number, that was already checked by json__scan_number, with integer arithmetic and a single float operation.
+// Returns false if the number needs json__number_slow to be rounded correctly.
+static bool json__number_fast(unsigned char const *s, size_t len, struct json_value *out) {
+    size_t i = 0;
+    bool negative = s[0] == '-';
+    if (negative) {
+        i += 1;
+    }
+
+    uint64_t mantissa = 0;
+    bool truncated = false;
+    long exponent = 0;
+    for (; i < len && s[i] >= '0' && s[i] <= '9'; i++) {
+        uint64_t digit = s[i] - '0';
+        if (mantissa > (UINT64_MAX - digit) / 10) {
+            truncated = true;
+            break;
+        }
+        mantissa = mantissa * 10 + digit;
+    }
+    if (truncated) {
+        return false;
+    }
+
+    bool integral = i == len;
+    if (i < len && s[i] == '.') {
+        for (i += 1; i < len && s[i] >= '0' && s[i] <= '9'; i++) {
+            uint64_t digit = s[i] - '0';
+            if (mantissa > (UINT64_MAX - digit) / 10) {
+                return false;
+            }
+            mantissa = mantissa * 10 + digit;
+            exponent -= 1;
+        }
+    }
+    if (i < len) {
+        // The exponent, bounding it is fine, anything this large goes to json__number_slow anyway
+        i += 1;
+        bool exponent_negative = s[i] == '-';
+        if (s[i] == '-' || s[i] == '+') {
+            i += 1;
+        }
+        long explicit_exponent = 0;
+        for (; i < len; i++) {
+            if (explicit_exponent < 100000) {
+                explicit_exponent = explicit_exponent * 10 + (s[i] - '0');
+            }
+        }
+        exponent += exponent_negative ? -explicit_exponent : explicit_exponent;
+    }
+
+    if (integral) {
+        if (!negative) {
+            *out = json_unsigned(mantissa);
+            return true;
+        }
+        // -0 is kept as a double, so the sign is not lost
+        if (mantissa != 0 && mantissa <= (uint64_t)INT64_MAX + 1) {
+            *out = json_integer(mantissa == (uint64_t)INT64_MAX + 1 ? INT64_MIN : -(int64_t) mantissa);
+            return true;
+        }
+        if (mantissa == 0) {
+            *out = json_number(-0.0);
+            return true;
+        }
+        return false;
+    }
+
+    // Clinger's fast path: both the mantissa and the power of ten are exact doubles, so a single multiplication
+    // or division is correctly rounded. This needs the operation to be done in double precision, not e.g. on a x87.
+#if !defined(FLT_EVAL_METHOD) || FLT_EVAL_METHOD != 0
+    return false;
+#endif
+    if (mantissa > ((uint64_t)1 << 53) || exponent < -22 || exponent > 22) {
+        return false;
+    }
+    double value = (double) mantissa;
+    if (exponent < 0) {
+        value /= json__exact_powers_of_ten[-exponent];
+    } else {
+        value *= json__exact_powers_of_ten[exponent];
+    }
+    *out = json_number(negative ? -value : value);
+    return true;
+}
+
+// Digits kept by json__number_slow, the ones behind them only matter to break a tie, see json__decimal.truncated
+#define JSON__DECIMAL_DIGITS 800
+// The largest shift, that can not overflow a uint64_t while shifting a digit
+#define JSON__DECIMAL_MAX_SHIFT 60
+
+// The number 0.digits[0]digits[1]...digits[len - 1] * 10^point, the digits are 0 to 9 without trailing zeros.
+struct json__decimal {
+    unsigned char digits[JSON__DECIMAL_DIGITS];
+    size_t len;
+    long point;
+    // Non zero digits were dropped behind the kept ones
+    bool truncated;
+};
+
+static void json__decimal_trim(struct json__decimal *d) {
+    while (d->len > 0 && d->digits[d->len - 1] == 0) {
+        d->len -= 1;
+    }
+    if (d->len == 0) {
+        d->point = 0;
+    }
+}
+
+static void json__decimal_push(struct json__decimal *d, unsigned char digit) {
+    if (d->len < JSON__DECIMAL_DIGITS) {
+        d->digits[d->len] = digit;
+        d->len += 1;
+    } else if (digit != 0) {
+        d->truncated = true;
+    }
+}
+
+// Multiplies by 2^shift
+static void json__decimal_left_shift(struct json__decimal *d, unsigned shift) {
+    // This adds at most 19 digits, the result is written back to front, so it is known where it starts at the end
+    unsigned char result[JSON__DECIMAL_DIGITS + 19];
+    size_t write = d->len + 19;
+    uint64_t n = 0;
+    for (size_t read = d->len; read-- > 0;) {
+        n += (uint64_t)d->digits[read] << shift;
+        result[--write] = (unsigned char)(n % 10);
+        n /= 10;
+    }
+    while (n > 0) {
+        result[--write] = (unsigned char)(n % 10);
+        n /= 10;
+    }
+
+    size_t len = d->len + 19 - write;
+    d->point += (long)(len - d->len);
+    if (len > JSON__DECIMAL_DIGITS) {
+        for (size_t i = JSON__DECIMAL_DIGITS; i < len; i++) {
+            d->truncated |= result[write + i] != 0;
+        }
+        len = JSON__DECIMAL_DIGITS;
+    }
+    memcpy(d->digits, &result[write], len);
+    d->len = len;
+    json__decimal_trim(d);
+}
+
+// Divides by 2^shift, the result is written over the digits that were already read
+static void json__decimal_right_shift(struct json__decimal *d, unsigned shift) {
+    size_t read = 0;
+    size_t write = 0;
+    uint64_t n = 0;
+    // Skip the digits, that would become leading zeros
+    for (; (n >> shift) == 0; read++) {
+        if (read >= d->len) {
+            if (n == 0) {
+                d->len = 0;
+                d->point = 0;
+                return;
+            }
+            while ((n >> shift) == 0) {
+                n *= 10;
+                read += 1;
+            }
+            break;
+        }
+        n = n * 10 + d->digits[read];
+    }
+    d->point -= (long)read - 1;
+
+    uint64_t mask = ((uint64_t)1 << shift) - 1;
+    for (; read < d->len; read++) {
+        d->digits[write] = (unsigned char)(n >> shift);
+        write += 1;
+        n = (n & mask) * 10 + d->digits[read];
+    }
+    d->len = write;
+    while (n > 0) {
+        json__decimal_push(d, (unsigned char)(n >> shift));
+        n = (n & mask) * 10;
+    }
+    json__decimal_trim(d);
+}
+
+// Multiplies by 2^shift, shift may be negative
+static void json__decimal_shift(struct json__decimal *d, int shift) {
+    if (d->len == 0) {
+        return;
+    }
+    for (; shift > JSON__DECIMAL_MAX_SHIFT; shift -= JSON__DECIMAL_MAX_SHIFT) {
+        json__decimal_left_shift(d, JSON__DECIMAL_MAX_SHIFT);
+    }
+    for (; shift < -JSON__DECIMAL_MAX_SHIFT; shift += JSON__DECIMAL_MAX_SHIFT) {
+        json__decimal_right_shift(d, JSON__DECIMAL_MAX_SHIFT);
+    }
+    if (shift > 0) {
+        json__decimal_left_shift(d, (unsigned)shift);
+    } else if (shift < 0) {
+        json__decimal_right_shift(d, (unsigned)-shift);
+    }
+}
+
+// The integer part, rounded half to even. d has to be smaller than 2^64.
+static uint64_t json__decimal_round(struct json__decimal const *d) {
+    // Below 0.1
+    if (d->point < 0) {
+        return 0;
+    }
+    uint64_t n = 0;
+    size_t point = (size_t)d->point;
+    for (size_t i = 0; i < point; i++) {
+        n = n * 10 + (i < d->len ? d->digits[i] : 0);
+    }
+    if (point >= d->len) {
+        return n;
+    }
+    // Exactly half, unless more digits follow or were dropped
+    if (d->digits[point] == 5 && point + 1 == d->len && !d->truncated) {
+        return n + (n & 1);
+    }
+    return n + (d->digits[point] >= 5);
+}
+
+// Converts a number, that was already checked by json__scan_number, correctly rounded and without strtod, which
+// would depend on the locale. The digits are shifted by powers of two, until the number is in [1, 2)
+// and the mantissa can be read from them. This is the simple decimal conversion, that Go's strconv also falls back to.
+static double json__number_slow(unsigned char const *s, size_t len) {
+    // shifts[i] bits move a number by at most i decimal digits, larger moves use 27 bits at a time
+    static int const shifts[] = { 1, 3, 6, 9, 13, 16, 19, 23, 26 };
+    uint64_t const infinity = (uint64_t)0x7FF << 52;
+
+    struct json__decimal d;
+    d.len = 0;
+    d.point = 0;
+    d.truncated = false;
+
+    size_t i = 0;
+    bool negative = s[0] == '-';
+    if (negative) {
+        i += 1;
+    }
+    for (; i < len && s[i] >= '0' && s[i] <= '9'; i++) {
+        if (d.len > 0 || s[i] != '0') {
+            json__decimal_push(&d, s[i] - '0');
+            d.point += 1;
+        }
+    }
+    if (i < len && s[i] == '.') {
+        for (i += 1; i < len && s[i] >= '0' && s[i] <= '9'; i++) {
+            if (d.len == 0 && s[i] == '0') {
+                d.point -= 1;
+            } else {
+                json__decimal_push(&d, s[i] - '0');
+            }
+        }
+    }
+    if (i < len) {
+        // Anything this large is infinity or zero anyway
+        i += 1;
+        bool exponent_negative = s[i] == '-';
+        if (s[i] == '-' || s[i] == '+') {
+            i += 1;
+        }
+        long exponent = 0;
+        for (; i < len; i++) {
+            if (exponent < 100000) {
+                exponent = exponent * 10 + (s[i] - '0');
+            }
+        }
+        d.point += exponent_negative ? -exponent : exponent;
+    }
+    json__decimal_trim(&d);
+
+    uint64_t bits = 0;
+    if (d.point > 310) {
+        bits = infinity;
+    } else if (d.len > 0 && d.point >= -330) {
+        int exponent = 0;
+        while (d.point > 0) {
+            int shift = d.point < 9 ? shifts[d.point] : 27;
+            json__decimal_shift(&d, -shift);
+            exponent += shift;
+        }
+        while (d.point < 0 || (d.point == 0 && d.digits[0] < 5)) {
+            int shift = -d.point < 9 ? shifts[-d.point] : 27;
+            json__decimal_shift(&d, shift);
+            exponent -= shift;
+        }
+        // The number is in [0.5, 1), the mantissa of a double is in [1, 2)
+        exponent -= 1;
+        // Subnormal numbers have the smallest exponent and a smaller mantissa instead
+        if (exponent < -1022) {
+            json__decimal_shift(&d, -(-1022 - exponent));
+            exponent = -1022;
+        }
+
+        json__decimal_shift(&d, 53);
+        uint64_t mantissa = json__decimal_round(&d);
+        // Rounding up can carry into a new bit
+        if (mantissa == (uint64_t)1 << 53) {
+            mantissa >>= 1;
+            exponent += 1;
+        }
+        if (exponent > 1023) {
+            bits = infinity;
+        } else {
+            // Without the implicit leading bit, the number is subnormal
+            uint64_t biased = (mantissa >> 52) == 0 ? 0 : (uint64_t)(exponent + 1023);
+            bits = (mantissa & (((uint64_t)1 << 52) - 1)) | (biased << 52);
+        }
+    }
+
+    if (negative) {
+        bits |= (uint64_t)1 << 63;
+    }
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static bool json__parse_number(struct json__parser *p, struct json_value *out) {
+    size_t start = p->pos;
+    unsigned char *s = p->input;
+    if (!json__scan_number(p)) {
+        return false;
+    }
+
+    if (!json__number_fast(&s[start], p->pos - start, out)) {
+        *out = json_number(json__number_slow(&s[start], p->pos - start));
+    }
+    return true;
+}
+
+static bool json__parse_array(struct json__parser *p, struct json_value *out) {
+    p->pos += 1;
+    struct json_array arr = json_array_create();
+
+    json__parse_skip_whitespace(p);
+    if (p->pos < p->len && p->input[p->pos] == ']') {
+        p->pos += 1;
+        *out = json_array_to_value(arr);
+        return true;
+    }
+
+    for (;;) {
+        struct json_value item;
+        if (!json__parse_value(p, &item)) {
+            json_array_delete(arr);
+            return false;
+        }
+
+        if (!json_array_push(&arr, item)) {
+            json_value_delete(item);
+            json_array_delete(arr);
+            return json__parse_fail(p, JSON_PARSE_OOM);
+        }
+
+        json__parse_skip_whitespace(p);
+        if (p->pos < p->len && p->input[p->pos] == ',') {
+            p->pos += 1;
+            continue;
+        }
+        if (p->pos < p->len && p->input[p->pos] == ']') {
+            p->pos += 1;
+            *out = json_array_to_value(arr);
+            return true;
+        }
+        json_array_delete(arr);
+        return json__parse_fail(p, JSON_PARSE_SYNTAX);
+    }
+}
+
+static bool json__parse_object(struct json__parser *p, struct json_value *out) {
+    p->pos += 1;
+    bool ok;
+    struct json_object obj = json_object_create(&ok);
+    if (!ok) {
+        return json__parse_fail(p, JSON_PARSE_OOM);
+    }
+
+    json__parse_skip_whitespace(p);
+    if (p->pos < p->len && p->input[p->pos] == '}') {
+        p->pos += 1;
+        *out = json_object_to_value(obj);
+        return true;
+    }
+
+    for (;;) {
+        json__parse_skip_whitespace(p);
+        if (p->pos >= p->len || p->input[p->pos] != '"') {
+            json_object_delete(obj);
+            return json__parse_fail(p, JSON_PARSE_SYNTAX);
+        }
+
+        // The key is copied by json_object_set anyway, so it only has to live until then
+        struct json_string key;
+        bool key_allocated;
+        if (!json__parse_string(p, &key, true, &key_allocated)) {
+            json_object_delete(obj);
+            return false;
+        }
+        if (p->options.keys != NULL) {
+            struct json_string interned = json_key_table_intern(p->options.keys, key, &ok);
+            if (key_allocated) {
+                json_string_delete(key);
+            }
+            if (!ok) {
+                json_object_delete(obj);
+                return json__parse_fail(p, JSON_PARSE_OOM);
+            }
+            key = interned;
+            key_allocated = false;
+        }
+
+        json__parse_skip_whitespace(p);
+        if (p->pos >= p->len || p->input[p->pos] != ':') {
+            if (key_allocated) {
+                json_string_delete(key);
+            }
+            json_object_delete(obj);
+            return json__parse_fail(p, JSON_PARSE_SYNTAX);
+        }
+        p->pos += 1;
+
+        struct json_value value;
+        if (!json__parse_value(p, &value)) {
+            if (key_allocated) {
+                json_string_delete(key);
+            }
+            json_object_delete(obj);
+            return false;
+        }
+
+        ok = json_object_set(&obj, key, value);
+        if (key_allocated) {
+            json_string_delete(key);
+        }
+        if (!ok) {
+            json_value_delete(value);
+            json_object_delete(obj);
+            return json__parse_fail(p, JSON_PARSE_OOM);
+        }
+
+        json__parse_skip_whitespace(p);
+        if (p->pos < p->len && p->input[p->pos] == ',') {
+            p->pos += 1;
+            continue;
+        }
+        if (p->pos < p->len && p->input[p->pos] == '}') {
+            p->pos += 1;
+            *out = json_object_to_value(obj);
+            return true;
+        }
+        json_object_delete(obj);
+        return json__parse_fail(p, JSON_PARSE_SYNTAX);
+    }
+}
+
+static bool json__parse_value(struct json__parser *p, struct json_value *out) {
+    json__parse_skip_whitespace(p);
+    if (p->pos >= p->len) {
+        return json__parse_fail(p, JSON_PARSE_SYNTAX);
+    }
+
+    bool ok;
+    switch (p->input[p->pos]) {
+        case '{':
+        case '[':
+            if (p->depth >= JSON_MAX_DEPTH) {
+                return json__parse_fail(p, JSON_PARSE_TOO_DEEP);
+            }
+            p->depth += 1;
+            ok = p->input[p->pos] == '{' ? json__parse_object(p, out) : json__parse_array(p, out);
+            p->depth -= 1;
+            return ok;
+        case '"': {
+            struct json_string str;
+            bool allocated;
+            if (!json__parse_string(p, &str, false, &allocated)) {
+                return false;
+            }
+            *out = json_string_to_value(str);
+            return true;
+        }
+        case 't':
+            *out = json_boolean(true);
+            return json__parse_literal(p, "true", 4);
+        case 'f':
+            *out = json_boolean(false);
+            return json__parse_literal(p, "false", 5);
+        case 'n':
+            *out = json_null();
+            return json__parse_literal(p, "null", 4);
+        default:
+            return json__parse_number(p, out);
+    }
+}
+
+struct json_parse_result json_parse(unsigned char *input, size_t len, struct json_parse_options options) {
+    struct json__parser p = {
+        .input = input,
+        .len = len,
+        .options = options,
+    };
+
+    struct json_value value;
+    if (json__parse_value(&p, &value)) {
+        json__parse_skip_whitespace(&p);
+        if (p.pos == p.len) {
+            return (struct json_parse_result) {
+                .value = value,
+                .error = JSON_PARSE_OK,
+            };
+        }
+        json_value_delete(value);
+        json__parse_fail(&p, JSON_PARSE_SYNTAX);
+    }
+
+    return (struct json_parse_result) {
+        .error = p.error,
+        .offset = p.pos,
+    };
+}
+
+//------------------------------
+// PATH IMPL
+//------------------------------
+
+// Checks if the segment is a valid array index, no leading zeros and no overflow
+static bool json__path_segment_index(struct json_string key, size_t *index) {
+    if (key.len == 0 || (key.len > 1 && key.data[0] == '0')) {
+        return false;
+    }
+
+    size_t value = 0;
+    for (size_t i = 0; i < key.len; i++) {
+        if (key.data[i] < '0' || key.data[i] > '9') {
+            return false;
+        }
+        size_t digit = key.data[i] - '0';
+        if (value > (SIZE_MAX - digit) / 10) {
+            return false;
+        }
+        value = value * 10 + digit;
+    }
+
+    *index = value;
+    return true;
+}
+
+struct json_path json_path_compile(char const *pointer, bool *ok) {
+    assert(ok != NULL);
+    struct json_path path = {0};
+    size_t len = strlen(pointer);
+
+    if (len == 0) {
+        *ok = true;
+        return path;
+    }
+    if (pointer[0] != '/') {
+        *ok = false;
+        return path;
+    }
+
+    size_t segments = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (pointer[i] == '/') {
+            segments += 1;
+        }
+    }
+
+    path.segments = JSON_CALLOC(segments, sizeof(*path.segments));
+    if (path.segments == NULL) {
+        *ok = false;
+        return path;
+    }
+
+    size_t start = 1;
+    while (path.len < segments) {
+        size_t end = start;
+        while (end < len && pointer[end] != '/') {
+            end += 1;
+        }
+
+        struct json_path_segment *segment = &path.segments[path.len];
+        unsigned char *data = NULL;
+        size_t data_len = 0;
+        if (end > start) {
+            data = JSON_MALLOC(end - start);
+            if (data == NULL) {
+                json_path_delete(path);
+                *ok = false;
+                return (struct json_path) {0};
+            }
+        }
+        for (size_t i = start; i < end; i++) {
+            if (pointer[i] != '~') {
+                data[data_len++] = (unsigned char) pointer[i];
+            } else if (i + 1 < end && pointer[i + 1] == '0') {
+                data[data_len++] = '~';
+                i += 1;
+            } else if (i + 1 < end && pointer[i + 1] == '1') {
+                data[data_len++] = '/';
+                i += 1;
+            } else {
+                JSON_FREE(data);
+                json_path_delete(path);
+                *ok = false;
+                return (struct json_path) {0};
+            }
+        }
+
+        segment->_key.data = data;
+        segment->_key.len = data_len;
+        segment->_hash = json__string_hash(segment->_key);
+        segment->_is_index = json__path_segment_index(segment->_key, &segment->_index);
+        path.len += 1;
+
+        start = end + 1;
+    }
+
+    *ok = true;
+    return path;
+}
+
+// Resolves a single segment of a path, relative to value
+static struct json_value json__path_step(struct json_value value, struct json_path_segment const *segment, bool *found) {
+    if (value.type == JSON_OBJECT) {
+        struct json__hash_map_entry *entry = json__hash_map_find(value.data.object._hm, segment->_key, segment->_hash);
+        *found = entry != NULL;
+        return entry != NULL ? entry->value : (struct json_value) {0};
+    }
+
+    if (value.type == JSON_ARRAY && segment->_is_index && segment->_index < value.data.array.len) {
+        *found = true;
+        return value.data.array.items[segment->_index];
+    }
+
+    *found = false;
+    return (struct json_value) {0};
+}
+
+struct json_value json_path_eval(struct json_value root, struct json_path const *path, bool *found) {
+    assert(found != NULL);
+    struct json_value value = root;
+    for (size_t i = 0; i < path->len; i++) {
+        value = json__path_step(value, &path->segments[i], found);
+        if (!*found) {
+            return value;
+        }
+    }
+
+    *found = true;
+    return value;
+}
+
+static bool json__path_segment_eq(struct json_path_segment const *first, struct json_path_segment const *second) {
+    return first->_hash == second->_hash && json__string_eq(first->_key, second->_key);
+}
+
+// qsort comparator for pointers to paths. It orders them by their segments, shorter paths first, so that all paths
+// with a common prefix end up next to each other. Array indices come first and in ascending order, so arrays are walked
+// front to back. Other segments are ordered by their hash first, that is cheaper than their bytes.
+static int json__path_compare(void const *first, void const *second) {
+    struct json_path const *a = *(struct json_path const *const *)first;
+    struct json_path const *b = *(struct json_path const *const *)second;
+    size_t len = a->len < b->len ? a->len : b->len;
+    for (size_t i = 0; i < len; i++) {
+        // Indices have no leading zeros, so equal indices are equal segments
+        if (a->segments[i]._is_index != b->segments[i]._is_index) {
+            return a->segments[i]._is_index ? -1 : 1;
+        }
+        if (a->segments[i]._is_index) {
+            if (a->segments[i]._index != b->segments[i]._index) {
+                return a->segments[i]._index < b->segments[i]._index ? -1 : 1;
+            }
+            continue;
+        }
+        if (a->segments[i]._hash != b->segments[i]._hash) {
+            return a->segments[i]._hash < b->segments[i]._hash ? -1 : 1;
+        }
+        struct json_string key_a = a->segments[i]._key;
+        struct json_string key_b = b->segments[i]._key;
+        if (key_a.len != key_b.len) {
+            return key_a.len < key_b.len ? -1 : 1;
+        }
+        int result = key_a.len == 0 ? 0 : memcmp(key_a.data, key_b.data, key_a.len);
+        if (result != 0) {
+            return result;
+        }
+    }
+    if (a->len != b->len) {
+        return a->len < b->len ? -1 : 1;
+    }
+    return 0;
+}
+
+void json_path_delete(struct json_path path) {
+    for (size_t i = 0; i < path.len; i++) {
+        json_string_delete(path.segments[i]._key);
+    }
+    JSON_FREE(path.segments);
+}
+
+// A node of the prefix tree of a json_path_set. The nodes are stored in depth first order, so the children of a node
+// directly follow it and the paths ending in its subtree are next to each other in _ends.
+struct json__path_set_node {
+    // The segment that leads from the parent to this node, unused for the root. Its key is owned by the path.
+    struct json_path_segment segment;
+    // The index behind the last node of the subtree
+    size_t next;
+    // The paths ending in the subtree start at _ends[first_end], the first own_ends of them end at this node
+    size_t first_end;
+    size_t own_ends;
+};
+
+struct json_path_set json_path_set_compile(struct json_path const *paths, size_t count, bool *ok) {
+    assert(ok != NULL);
+    struct json_path_set set = { ._count = count };
+
+    size_t node_count = 1;
+    size_t max_len = 0;
+    for (size_t i = 0; i < count; i++) {
+        node_count += paths[i].len;
+        max_len = paths[i].len > max_len ? paths[i].len : max_len;
+    }
+
+    set._nodes = JSON_MALLOC(node_count * sizeof(*set._nodes));
+    set._ends = JSON_MALLOC((count == 0 ? 1 : count) * sizeof(*set._ends));
+    struct json_path const **order = JSON_MALLOC((count == 0 ? 1 : count) * sizeof(*order));
+    // chain[d] is the node at depth d of the previous path
+    size_t *chain = JSON_MALLOC((max_len + 1) * sizeof(*chain));
+    if (set._nodes == NULL || set._ends == NULL || order == NULL || chain == NULL) {
+        JSON_FREE(order);
+        JSON_FREE(chain);
+        json_path_set_delete(set);
+        *ok = false;
+        return (struct json_path_set) {0};
+    }
+
+    // Sorted paths are the depth first order of the prefix tree, so each path only shares nodes with the one before it
+    for (size_t i = 0; i < count; i++) {
+        order[i] = &paths[i];
+    }
+    qsort(order, count, sizeof(*order), json__path_compare);
+
+    set._nodes[0] = (struct json__path_set_node) {0};
+    chain[0] = 0;
+    size_t chain_len = 1;
+    node_count = 1;
+    for (size_t i = 0; i < count; i++) {
+        struct json_path const *path = order[i];
+        size_t depth = 0;
+        while (depth + 1 < chain_len && depth < path->len && json__path_segment_eq(&set._nodes[chain[depth + 1]].segment, &path->segments[depth])) {
+            depth += 1;
+        }
+
+        for (size_t d = depth + 1; d < chain_len; d++) {
+            set._nodes[chain[d]].next = node_count;
+        }
+        for (; depth < path->len; depth++) {
+            set._nodes[node_count] = (struct json__path_set_node) {
+                .segment = path->segments[depth],
+                .first_end = i,
+            };
+            chain[depth + 1] = node_count;
+            node_count += 1;
+        }
+        chain_len = path->len + 1;
+
+        set._nodes[chain[path->len]].own_ends += 1;
+        set._ends[i] = (size_t)(path - paths);
+    }
+    for (size_t d = 0; d < chain_len; d++) {
+        set._nodes[chain[d]].next = node_count;
+    }
+
+    JSON_FREE(order);
+    JSON_FREE(chain);
+    *ok = true;
+    return set;
+}
+
+// Resolves all the paths ending in the subtree of the node at index, the node itself resolved to value
+static void json__path_set_eval_node(struct json_path_set const *set, size_t index, struct json_value value, struct json_value *values, bool *found) {
+    struct json__path_set_node const *node = &set->_nodes[index];
+    for (size_t i = node->first_end; i < node->first_end + node->own_ends; i++) {
+        values[set->_ends[i]] = value;
+        found[set->_ends[i]] = true;
+    }
+
+    for (size_t child = index + 1; child < node->next; child = set->_nodes[child].next) {
+        bool child_found;
+        struct json_value child_value = json__path_step(value, &set->_nodes[child].segment, &child_found);
+        if (child_found) {
+            json__path_set_eval_node(set, child, child_value, values, found);
+            continue;
+        }
+
+        // Nothing below a missing value can be found
+        size_t end = set->_nodes[child].next < set->_nodes[0].next ? set->_nodes[set->_nodes[child].next].first_end : set->_count;
+        for (size_t i = set->_nodes[child].first_end; i < end; i++) {
+            values[set->_ends[i]] = (struct json_value) {0};
+            found[set->_ends[i]] = false;
+        }
+    }
+}
+
+void json_path_set_eval(struct json_value root, struct json_path_set const *set, struct json_value *values, bool *found) {
+    json__path_set_eval_node(set, 0, root, values, found);
+}
+
+void json_path_set_delete(struct json_path_set set) {
+    JSON_FREE(set._nodes);
+    JSON_FREE(set._ends);
+}
+
+//------------------------------
+// TAPE IMPL
+//------------------------------
+
+struct json__tape_entry {
+    // Byte offset of the first character of the value
+    size_t start;
+    // Byte offset behind the last character of the value
+    size_t end;
+    // The index of the entry behind this value and everything inside of it
+    size_t next;
+};
+
+static bool json__tape_push(struct json__parser *p, struct json_tape *tape, size_t *index) {
+    if (tape->_len == tape->_cap) {
+        size_t new_cap = tape->_cap == 0 ? 64 : tape->_cap * 2;
+        struct json__tape_entry *entries = JSON_REALLOC(tape->_entries, new_cap * sizeof(*entries));
+        if (entries == NULL) {
+            return json__parse_fail(p, JSON_PARSE_OOM);
+        }
+        tape->_entries = entries;
+        tape->_cap = new_cap;
+    }
+
+    *index = tape->_len;
+    tape->_entries[tape->_len] = (struct json__tape_entry) {
+        .start = p->pos,
+        .next = tape->_len + 1,
+    };
+    tape->_len += 1;
+    return true;
+}
+
+static bool json__tape_scalar(struct json__parser *p) {
+    switch (p->input[p->pos]) {
+        case '"': {
+            size_t raw_len;
+            bool escaped;
+            p->pos += 1;
+            return json__parse_string_span(p, &raw_len, &escaped);
+        }
+        case 't':
+            return json__parse_literal(p, "true", 4);
+        case 'f':
+            return json__parse_literal(p, "false", 5);
+        case 'n':
+            return json__parse_literal(p, "null", 4);
+        default:
+            return json__scan_number(p);
+    }
+}
+
+// Adds a key and skips the colon after it
+static bool json__tape_key(struct json__parser *p, struct json_tape *tape) {
+    json__parse_skip_whitespace(p);
+    if (p->pos >= p->len || p->input[p->pos] != '"') {
+        return json__parse_fail(p, JSON_PARSE_SYNTAX);
+    }
+
+    size_t index;
+    if (!json__tape_push(p, tape, &index) || !json__tape_scalar(p)) {
+        return false;
+    }
+    tape->_entries[index].end = p->pos;
+
+    json__parse_skip_whitespace(p);
+    if (p->pos >= p->len || p->input[p->pos] != ':') {
+        return json__parse_fail(p, JSON_PARSE_SYNTAX);
+    }
+    p->pos += 1;
+    return true;
+}
+
+// Does not recurse, the currently open objects and arrays are kept in a stack instead
+static bool json__tape_scan(struct json__parser *p, struct json_tape *tape) {
+    size_t *open = NULL;
+    size_t open_cap = 0;
+    bool ok = false;
+
+    for (;;) {
+        // Expecting a value
+        json__parse_skip_whitespace(p);
+        if (p->pos >= p->len) {
+            json__parse_fail(p, JSON_PARSE_SYNTAX);
+            goto done;
+        }
+
+        size_t index;
+        if (!json__tape_push(p, tape, &index)) {
+            goto done;
+        }
+
+        unsigned char c = p->input[p->pos];
+        if (c == '{' || c == '[') {
+            if (p->depth >= JSON_MAX_DEPTH) {
+                json__parse_fail(p, JSON_PARSE_TOO_DEEP);
+                goto done;
+            }
+            if (p->depth == open_cap) {
+                size_t new_cap = open_cap == 0 ? 16 : open_cap * 2;
+                size_t *new_open = JSON_REALLOC(open, new_cap * sizeof(*new_open));
+                if (new_open == NULL) {
+                    json__parse_fail(p, JSON_PARSE_OOM);
+                    goto done;
+                }
+                open = new_open;
+                open_cap = new_cap;
+            }
+            open[p->depth] = index;
+            p->depth += 1;
+            p->pos += 1;
+
+            json__parse_skip_whitespace(p);
+            bool empty = p->pos < p->len && p->input[p->pos] == (c == '{' ? '}' : ']');
+            if (!empty) {
+                if (c == '{' && !json__tape_key(p, tape)) {
+                    goto done;
+                }
+                continue;
+            }
+        } else {
+            if (!json__tape_scalar(p)) {
+                goto done;
+            }
+            tape->_entries[index].end = p->pos;
+        }
+
+        // After a value, close the finished objects and arrays until there is a next item
+        for (;;) {
+            if (p->depth == 0) {
+                ok = true;
+                goto done;
+            }
+
+            struct json__tape_entry *container = &tape->_entries[open[p->depth - 1]];
+            bool is_object = p->input[container->start] == '{';
+            json__parse_skip_whitespace(p);
+            if (p->pos >= p->len) {
+                json__parse_fail(p, JSON_PARSE_SYNTAX);
+                goto done;
+            }
+
+            c = p->input[p->pos];
+            if (c == (is_object ? '}' : ']')) {
+                p->pos += 1;
+                container->end = p->pos;
+                container->next = tape->_len;
+                p->depth -= 1;
+                continue;
+            }
+            if (c != ',') {
+                json__parse_fail(p, JSON_PARSE_SYNTAX);
+                goto done;
+            }
+            p->pos += 1;
+            if (is_object && !json__tape_key(p, tape)) {
+                goto done;
+            }
+            break;
+        }
+    }
+
+done:
+    JSON_FREE(open);
+    return ok;
+}
+
+struct json_tape_result json_tape_parse(unsigned char *input, size_t len) {
+    struct json__parser p = {
+        .input = input,
+        .len = len,
+    };
+    struct json_tape tape = {
+        ._input = input,
+    };
+
+    if (json__tape_scan(&p, &tape)) {
+        json__parse_skip_whitespace(&p);
+        if (p.pos == p.len) {
+            return (struct json_tape_result) {
+                .tape = tape,
+                .error = JSON_PARSE_OK,
+            };
+        }
+        json__parse_fail(&p, JSON_PARSE_SYNTAX);
+    }
+
+    json_tape_delete(tape);
+    return (struct json_tape_result) {
+        .error = p.error,
+        .offset = p.pos,
+    };
+}
+
+void json_tape_delete(struct json_tape tape) {
+    JSON_FREE(tape._entries);
+}
+
+struct json_node json_tape_root(struct json_tape *tape) {
+    return (struct json_node) {
+        ._tape = tape,
+        ._index = 0,
+    };
+}
+
+enum json_type json_node_type(struct json_node node) {
+    switch (node._tape->_input[node._tape->_entries[node._index].start]) {
+        case '{': return JSON_OBJECT;
+        case '[': return JSON_ARRAY;
+        case '"': return JSON_STRING;
+        case 't':
+        case 'f': return JSON_BOOLEAN;
+        case 'n': return JSON_NULL;
+        // Numbers are only split into JSON_NUMBER, JSON_INTEGER and JSON_UNSIGNED by json_node_value
+        default: return JSON_NUMBER;
+    }
+}
+
+static bool json__tape_key_eq(struct json_tape *tape, struct json__tape_entry *entry, struct json_string key) {
+    unsigned char *raw = &tape->_input[entry->start + 1];
+    size_t raw_len = entry->end - entry->start - 2;
+
+    if (memchr(raw, '\\', raw_len) == NULL) {
+        return json__string_eq((struct json_string) { .data = raw, .len = raw_len }, key);
+    }
+
+    // Decoding never makes a string longer, so a shorter raw key can not be equal
+    if (raw_len < json_string_len(key)) {
+        return false;
+    }
+
+    unsigned char small[64];
+    unsigned char *buffer = small;
+    if (raw_len > sizeof(small)) {
+        buffer = JSON_MALLOC(raw_len);
+        if (buffer == NULL) {
+            return false;
+        }
+    }
+
+    size_t len = json__unescape(buffer, raw, raw_len);
+    bool eq = len != (size_t)-1 && json__string_eq((struct json_string) { .data = buffer, .len = len }, key);
+
+    if (buffer != small) {
+        JSON_FREE(buffer);
+    }
+    return eq;
+}
+
+struct json_node json_node_get(struct json_node node, struct json_string key, bool *found) {
+    assert(found != NULL);
+    struct json_tape *tape = node._tape;
+    *found = false;
+    if (json_node_type(node) != JSON_OBJECT) {
+        return node;
+    }
+
+    // Entries alternate between key and value, values are skipped with their next index.
+    // All keys have to be checked, a later duplicate wins.
+    size_t end = tape->_entries[node._index].next;
+    size_t match = 0;
+    for (size_t i = node._index + 1; i < end; i = tape->_entries[i + 1].next) {
+        if (json__tape_key_eq(tape, &tape->_entries[i], key)) {
+            match = i + 1;
+        }
+    }
+    if (match == 0) {
+        return node;
+    }
+    *found = true;
+    return (struct json_node) {
+        ._tape = tape,
+        ._index = match,
+    };
+}
+
+struct json_node json_node_at(struct json_node node, size_t index, bool *found) {
+    assert(found != NULL);
+    struct json_tape *tape = node._tape;
+    *found = false;
+    if (json_node_type(node) != JSON_ARRAY) {
+        return node;
+    }
+
+    size_t end = tape->_entries[node._index].next;
+    size_t current = 0;
+    for (size_t i = node._index + 1; i < end; i = tape->_entries[i].next) {
+        if (current == index) {
+            *found = true;
+            return (struct json_node) {
+                ._tape = tape,
+                ._index = i,
+            };
+        }
+        current += 1;
+    }
+    return node;
+}
+
+struct json_node json_node_path(struct json_node node, struct json_path const *path, bool *found) {
+    assert(found != NULL);
+    *found = true;
+    for (size_t i = 0; i < path->len && *found; i++) {
+        struct json_path_segment const *segment = &path->segments[i];
+        switch (json_node_type(node)) {
+            case JSON_OBJECT:
+                node = json_node_get(node, segment->_key, found);
+                break;
+            case JSON_ARRAY:
+                *found = segment->_is_index;
+                if (*found) {
+                    node = json_node_at(node, segment->_index, found);
+                }
+                break;
+            default:
+                *found = false;
+                break;
+        }
+    }
+    return node;
+}
+
+struct json_parse_result json_node_value(struct json_node node, struct json_parse_options options) {
+    struct json__tape_entry *entry = &node._tape->_entries[node._index];
+    struct json__parser p = {
+        .input = node._tape->_input,
+        .len = entry->end,
+        .pos = entry->start,
+        .options = options,
+    };
+
+    struct json_value value;
+    if (json__parse_value(&p, &value)) {
+        return (struct json_parse_result) {
+            .value = value,
+            .error = JSON_PARSE_OK,
+        };
+    }
+
+    return (struct json_parse_result) {
+        .error = p.error,
+        .offset = p.pos,
+    };
+}
+
+//------------------------------
+// NDJSON IMPL
+//------------------------------
+
+// Finds the next non empty record at or after *pos and before end. memchr is vectorized by every relevant libc.
+static bool json__ndjson_next_record(unsigned char *input, size_t *pos, size_t end, size_t *record_start, size_t *record_end) {
+    while (*pos < end) {
+        unsigned char *newline = memchr(&input[*pos], '\n', end - *pos);
+        size_t line_end = newline == NULL ? end : (size_t)(newline - input);
+        size_t line_start = *pos;
+        *pos = newline == NULL ? end : line_end + 1;
+
+        for (size_t i = line_start; i < line_end; i++) {
+            unsigned char c = input[i];
+            if (c != ' ' && c != '\t' && c != '\r') {
+                *record_start = line_start;
+                *record_end = line_end;
+                return true;
+            }
+        }
     }
+    return false;
+}
 
-    struct json__hash_map_entry *collisions = JSON_CALLOC(JSON_INITIAL_BUCKET_SIZE, sizeof(*collisions));
+static enum json_parse_error json__ndjson_parse_sequential(unsigned char *input, size_t len, struct json_parse_options options, json_ndjson_callback callback, void *user) {
+    size_t pos = 0;
+    size_t index = 0;
+    size_t start, end;
+    while (json__ndjson_next_record(input, &pos, len, &start, &end)) {
+        struct json_ndjson_record record = {
+            .index = index,
+            .offset = start,
+            .result = json_parse(&input[start], end - start, options),
+        };
+        index += 1;
+        if (!callback(user, &record)) {
+            break;
+        }
+    }
+    return JSON_PARSE_OK;
+}
 
-    *ptr = (struct json__hash_map) {
-        .bucket_cap = JSON_INITIAL_BUCKET_SIZE,
-        .bucket = bucket,
+#ifdef JSON_PTHREADS
+
+#define JSON__NDJSON_DEFAULT_CHUNK_SIZE ((size_t)1 << 20)
+
+struct json__ndjson_chunk {
+    size_t start;
+    size_t end;
+    struct json_ndjson_record *records;
+    size_t records_len;
+    size_t records_cap;
+    // The records before this one are owned by the callback
+    size_t records_delivered;
+    enum json_parse_error error;
+    bool done;
+};
+
+// Splits the input into chunks of about chunk_size bytes, which all end behind a newline
+static bool json__ndjson_split(unsigned char *input, size_t len, size_t chunk_size, struct json__ndjson_chunk **chunks, size_t *chunks_len) {
+    size_t cap = len / chunk_size + 1;
+    *chunks = JSON_CALLOC(cap, sizeof(**chunks));
+    *chunks_len = 0;
+    if (*chunks == NULL) {
+        return false;
+    }
+
+    size_t pos = 0;
+    while (pos < len) {
+        size_t end = len;
+        if (len - pos > chunk_size) {
+            unsigned char *newline = memchr(&input[pos + chunk_size], '\n', len - pos - chunk_size);
+            end = newline == NULL ? len : (size_t)(newline - input) + 1;
+        }
+        (*chunks)[*chunks_len] = (struct json__ndjson_chunk) {
+            .start = pos,
+            .end = end,
+        };
+        *chunks_len += 1;
+        pos = end;
+    }
+    return true;
+}
+
+// Parses all records of the chunk into chunk->records, the index of the records is set on delivery
+static void json__ndjson_parse_chunk(unsigned char *input, struct json__ndjson_chunk *chunk, struct json_parse_options options) {
+    size_t pos = chunk->start;
+    size_t start, end;
+    while (json__ndjson_next_record(input, &pos, chunk->end, &start, &end)) {
+        if (chunk->records_len == chunk->records_cap) {
+            size_t new_cap = chunk->records_cap == 0 ? 64 : chunk->records_cap * 2;
+            struct json_ndjson_record *records = JSON_REALLOC(chunk->records, new_cap * sizeof(*records));
+            if (records == NULL) {
+                chunk->error = JSON_PARSE_OOM;
+                return;
+            }
+            chunk->records = records;
+            chunk->records_cap = new_cap;
+        }
+
+        chunk->records[chunk->records_len] = (struct json_ndjson_record) {
+            .offset = start,
+            .result = json_parse(&input[start], end - start, options),
+        };
+        chunk->records_len += 1;
+    }
+}
+
+static void json__ndjson_chunk_delete(struct json__ndjson_chunk *chunk) {
+    for (size_t i = chunk->records_delivered; i < chunk->records_len; i++) {
+        if (chunk->records[i].result.error == JSON_PARSE_OK) {
+            json_value_delete(chunk->records[i].result.value);
+        }
+    }
+    JSON_FREE(chunk->records);
+    chunk->records = NULL;
+    chunk->records_len = 0;
+}
+
+// Passes the records of a chunk to the callback, returns false if the callback wants to stop
+static bool json__ndjson_deliver(struct json__ndjson_chunk *chunk, size_t *index, json_ndjson_callback callback, void *user) {
+    while (chunk->records_delivered < chunk->records_len) {
+        struct json_ndjson_record *record = &chunk->records[chunk->records_delivered];
+        record->index = *index;
+        *index += 1;
+        chunk->records_delivered += 1;
+        if (!callback(user, record)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct json__ndjson_pool {
+    unsigned char *input;
+    struct json_parse_options options;
+    struct json__ndjson_chunk *chunks;
+    size_t chunks_len;
+    // The next chunk a worker will take
+    size_t next;
+    // The amount of chunks that were passed to the callback
+    size_t delivered;
+    // Workers do not run further ahead of the callback than this many chunks, so the memory use stays bounded
+    size_t window;
+    bool stop;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+static void *json__ndjson_worker(void *arg) {
+    struct json__ndjson_pool *pool = arg;
+    pthread_mutex_lock(&pool->mutex);
+    for (;;) {
+        while (!pool->stop && pool->next < pool->chunks_len && pool->next >= pool->delivered + pool->window) {
+            pthread_cond_wait(&pool->cond, &pool->mutex);
+        }
+        if (pool->stop || pool->next >= pool->chunks_len) {
+            break;
+        }
+
+        struct json__ndjson_chunk *chunk = &pool->chunks[pool->next];
+        pool->next += 1;
+        pthread_mutex_unlock(&pool->mutex);
+
+        json__ndjson_parse_chunk(pool->input, chunk, pool->options);
+
+        pthread_mutex_lock(&pool->mutex);
+        chunk->done = true;
+        pthread_cond_broadcast(&pool->cond);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
 
-        .collisions = collisions,
-        .collisions_cap = JSON_INITIAL_BUCKET_SIZE,
+static enum json_parse_error json__ndjson_parse_threaded(unsigned char *input, size_t len, struct json_ndjson_options options, json_ndjson_callback callback, void *user) {
+    struct json__ndjson_pool pool = {
+        .input = input,
+        .options = options.parse,
+        .window = options.threads * 2,
     };
+    size_t chunk_size = options.chunk_size == 0 ? JSON__NDJSON_DEFAULT_CHUNK_SIZE : options.chunk_size;
+    if (!json__ndjson_split(input, len, chunk_size, &pool.chunks, &pool.chunks_len)) {
+        return JSON_PARSE_OOM;
+    }
+    if (pool.chunks_len == 0) {
+        JSON_FREE(pool.chunks);
+        return JSON_PARSE_OK;
+    }
 
-    return ptr;
+    size_t thread_count = options.threads < pool.chunks_len ? options.threads : pool.chunks_len;
+    pthread_t *threads = JSON_MALLOC(thread_count * sizeof(*threads));
+    if (threads == NULL || pthread_mutex_init(&pool.mutex, NULL) != 0) {
+        JSON_FREE(threads);
+        JSON_FREE(pool.chunks);
+        return JSON_PARSE_OOM;
+    }
+    if (pthread_cond_init(&pool.cond, NULL) != 0) {
+        pthread_mutex_destroy(&pool.mutex);
+        JSON_FREE(threads);
+        JSON_FREE(pool.chunks);
+        return JSON_PARSE_OOM;
+    }
+
+    size_t started = 0;
+    while (started < thread_count && pthread_create(&threads[started], NULL, json__ndjson_worker, &pool) == 0) {
+        started += 1;
+    }
+
+    enum json_parse_error error = started == 0 ? JSON_PARSE_OOM : JSON_PARSE_OK;
+    size_t index = 0;
+    for (size_t i = 0; i < pool.chunks_len && started > 0; i++) {
+        struct json__ndjson_chunk *chunk = &pool.chunks[i];
+        pthread_mutex_lock(&pool.mutex);
+        while (!chunk->done) {
+            pthread_cond_wait(&pool.cond, &pool.mutex);
+        }
+        pthread_mutex_unlock(&pool.mutex);
+
+        bool keep_going = chunk->error == JSON_PARSE_OK;
+        if (!keep_going) {
+            error = chunk->error;
+        } else {
+            keep_going = json__ndjson_deliver(chunk, &index, callback, user);
+        }
+        json__ndjson_chunk_delete(chunk);
+
+        pthread_mutex_lock(&pool.mutex);
+        pool.delivered = i + 1;
+        pool.stop = !keep_going;
+        pthread_cond_broadcast(&pool.cond);
+        pthread_mutex_unlock(&pool.mutex);
+        if (!keep_going) {
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    // Chunks that were parsed, but never delivered
+    for (size_t i = 0; i < pool.chunks_len; i++) {
+        json__ndjson_chunk_delete(&pool.chunks[i]);
+    }
+
+    pthread_cond_destroy(&pool.cond);
+    pthread_mutex_destroy(&pool.mutex);
+    JSON_FREE(threads);
+    JSON_FREE(pool.chunks);
+    return error;
 }
 
-// Deletes all the values, keys and the internal memory of the hash map
-static void json__hm_delete(struct json__hash_map* map) {
-    for (size_t i = 0; i < map->collisions_size; i++) {
-        if (json__hash_map_entry_valid(&map->collisions[i])) {
-            json_string_delete(map->collisions[i].key);
-            json_value_delete(map->collisions[i].value);
+#endif // JSON_PTHREADS
+
+enum json_parse_error json_ndjson_parse(unsigned char *input, size_t len, struct json_ndjson_options options, json_ndjson_callback callback, void *user) {
+#ifdef JSON_PTHREADS
+    // A json_key_table is not thread safe, so with keys the records are parsed on the calling thread
+    if (options.threads > 1 && options.parse.keys == NULL) {
+        return json__ndjson_parse_threaded(input, len, options, callback, user);
+    }
+#endif
+    return json__ndjson_parse_sequential(input, len, options.parse, callback, user);
+}
+
+//------------------------------
+// INTERNAL HASH MAP FACILITIES
+//------------------------------
+
+#define JSON__GROUP_WIDTH 16
+#define JSON__CTRL_EMPTY ((unsigned char) 0x80)
+#define JSON__CTRL_DELETED ((unsigned char) 0xFE)
+
+// One bit per slot in a group, bit i is set if slot i matched
+typedef unsigned int json__group_mask;
+
+#ifdef JSON__DEFAULT_HASH
+#define JSON__HASH_PRIME_1 UINT64_C(0x9E3779B185EBCA87)
+#define JSON__HASH_PRIME_2 UINT64_C(0xC2B2AE3D27D4EB4F)
+
+static uint64_t json__read_u64(unsigned char const *str) {
+    uint64_t value;
+    memcpy(&value, str, sizeof(value));
+    return value;
+}
+
+static uint64_t json__rotl(uint64_t value, unsigned bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// Generate a hash value
+// Processes 8 bytes at a time, the final avalanche makes sure that both the low bits (control byte) and the high bits (group) are usable.
+static size_t json__hash(unsigned char const * str, size_t len) {
+    uint64_t hash = JSON__HASH_PRIME_2 ^ ((uint64_t)len * JSON__HASH_PRIME_1);
+
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        hash ^= json__rotl(json__read_u64(str + i) * JSON__HASH_PRIME_2, 31) * JSON__HASH_PRIME_1;
+        hash = json__rotl(hash, 27) * JSON__HASH_PRIME_1 + JSON__HASH_PRIME_2;
+    }
+
+    if (i < len) {
+        uint64_t tail = 0;
+        memcpy(&tail, str + i, len - i);
+        hash ^= json__rotl(tail * JSON__HASH_PRIME_2, 31) * JSON__HASH_PRIME_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= JSON__HASH_PRIME_2;
+    hash ^= hash >> 29;
+    hash *= JSON__HASH_PRIME_1;
+    hash ^= hash >> 32;
+
+    return (size_t)hash;
+}
+#endif // JSON__DEFAULT_HASH
+
+static size_t json__string_hash(struct json_string str) {
+    if (str.len & JSON__STRING_INTERNED) {
+        size_t hash;
+        memcpy(&hash, str.data - sizeof(hash), sizeof(hash));
+        return hash;
+    }
+    return JSON_HASH(str.data, json_string_len(str));
+}
+
+// Interned keys and views are shared with their tag, everything else is copied
+static struct json_string json__string_copy_key(struct json_string str, bool *ok) {
+    if (str.len & JSON__STRING_TAGS) {
+        *ok = true;
+        return str;
+    }
+    return json_string_copy(str, ok);
+}
+
+// The lower 7 bits of the hash, stored in the control byte
+static unsigned char json__hash_h2(size_t hash) {
+    return (unsigned char)(hash & 0x7F);
+}
+
+// The rest of the hash, used to select the first group
+static size_t json__hash_h1(size_t hash) {
+    return hash >> 7;
+}
+
+static unsigned json__ctz(json__group_mask mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return (unsigned) __builtin_ctz(mask);
+#else
+    unsigned count = 0;
+    while ((mask & 1u) == 0) {
+        mask >>= 1;
+        count += 1;
+    }
+    return count;
+#endif
+}
+
+// Returns a mask of all slots in the group whose control byte is equal to ctrl
+static json__group_mask json__group_match(unsigned char const *group, unsigned char ctrl) {
+#ifdef JSON__USE_SSE2
+    __m128i bytes = _mm_loadu_si128((__m128i const *) group);
+    return (json__group_mask) _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8((char) ctrl)));
+#else
+    json__group_mask mask = 0;
+    for (unsigned i = 0; i < JSON__GROUP_WIDTH; i++) {
+        if (group[i] == ctrl) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+#endif
+}
+
+// Returns a mask of all slots in the group that are either empty or deleted. Both have the high bit set, full slots do not.
+static json__group_mask json__group_match_free(unsigned char const *group) {
+#ifdef JSON__USE_SSE2
+    return (json__group_mask) _mm_movemask_epi8(_mm_loadu_si128((__m128i const *) group));
+#else
+    json__group_mask mask = 0;
+    for (unsigned i = 0; i < JSON__GROUP_WIDTH; i++) {
+        if (group[i] & 0x80) {
+            mask |= 1u << i;
         }
     }
+    return mask;
+#endif
+}
+
+// Rounds up to the next power of two, which is at least JSON__GROUP_WIDTH
+static size_t json__hash_map_round_cap(size_t cap) {
+    size_t result = JSON__GROUP_WIDTH;
+    while (result < cap) {
+        result *= 2;
+    }
+    return result;
+}
+
+// Returns NULL if an allocation failed
+static struct json__hash_map* json__hm_create(void) {
+    struct json__hash_map* ptr = JSON_MALLOC(sizeof(*ptr));
+    if (ptr == NULL) {
+        return NULL;
+    }
+
+    // The map starts small, the entries are allocated on the first insert
+    *ptr = (struct json__hash_map) {
+        .refs = 1,
+    };
+
+#if JSON_SMALL_OBJECT_SIZE == 0
+    if (!json__hash_map_rehash(ptr, json__hash_map_round_cap(JSON_INITIAL_BUCKET_SIZE))) {
+        JSON_FREE(ptr);
+        return NULL;
+    }
+#endif
+
+    return ptr;
+}
 
-    for (size_t i = 0; i < map->bucket_cap; i++) {
-        if (json__hash_map_entry_valid(&map->bucket[i])) {
-            json_string_delete(map->bucket[i].key);
-            json_value_delete(map->bucket[i].value);
+// Deletes all the values, keys and the internal memory of the hash map
+static void json__hm_delete(struct json__hash_map* map) {
+    for (size_t i = 0; i < map->cap; i++) {
+        if (json__hash_map_slot_full(map, i)) {
+            json__hash_map_entry_delete(&map->entries[i]);
         }
     }
 
-    JSON_FREE(map->collisions);
-    JSON_FREE(map->bucket);
+    JSON_FREE(map->ctrl);
+    JSON_FREE(map->entries);
     JSON_FREE(map);
 }
 
+// Either string may be tagged
 static bool json__string_eq(struct json_string first, struct json_string second) {
-    if (first.len != second.len) {
+    size_t len = json_string_len(first);
+    if (len != json_string_len(second)) {
         return false;
     }
 
-    for (size_t i = 0; i < first.len; i++) {
-        if (first.data[i] != second.data[i]) {
-            return false;
-        }
+    // Interned keys are compared by their pointer
+    if (len == 0 || first.data == second.data) {
+        return true;
     }
 
-    return true;
+    return memcmp(first.data, second.data, len) == 0;
 }
 
-// NOTE: Returns NULL if not found
-static struct json__hash_map_entry* json__hash_map_get(struct json__hash_map *hm, struct json_string key) {
-    size_t hash = json__hash(key.data, key.len);
-    size_t index = hash % hm->bucket_cap;
-    struct json__hash_map_entry *entry = &hm->bucket[index];
+static bool json__hash_map_slot_full(struct json__hash_map *hm, size_t index) {
+    if (hm->ctrl == NULL) {
+        return index < hm->size;
+    }
+    return (hm->ctrl[index] & 0x80) == 0;
+}
 
-    if (!json__hash_map_entry_valid(entry)) {
+// NOTE: Returns NULL if not found
+static struct json__hash_map_entry* json__hash_map_find(struct json__hash_map *hm, struct json_string key, size_t hash) {
+    if (hm->ctrl == NULL) {
+        for (size_t i = 0; i < hm->size; i++) {
+            struct json__hash_map_entry *entry = &hm->entries[i];
+            if (entry->hash == hash && json__string_eq(entry->key, key)) {
+                return entry;
+            }
+        }
         return NULL;
     }
 
-    if (json__string_eq(entry->key, key)) {
-        return entry;
-    }
+    size_t group_mask = hm->cap / JSON__GROUP_WIDTH - 1;
+    size_t group = json__hash_h1(hash) & group_mask;
+    unsigned char h2 = json__hash_h2(hash);
+
+    // Triangular probing over the groups, visits every group once because the group count is a power of two
+    for (size_t step = 0; step <= group_mask; step++) {
+        unsigned char const *ctrl = &hm->ctrl[group * JSON__GROUP_WIDTH];
 
-    while (entry->next != NULL) {
-        entry = entry->next;
-        if (json__string_eq(entry->key, key)) {
-            return entry;
+        json__group_mask match = json__group_match(ctrl, h2);
+        while (match != 0) {
+            size_t index = group * JSON__GROUP_WIDTH + json__ctz(match);
+            struct json__hash_map_entry *entry = &hm->entries[index];
+            if (entry->hash == hash && json__string_eq(entry->key, key)) {
+                return entry;
+            }
+            match &= match - 1;
+        }
+
+        // A group with a empty slot ends every probe sequence that went through it
+        if (json__group_match(ctrl, JSON__CTRL_EMPTY) != 0) {
+            return NULL;
         }
+
+        group = (group + step + 1) & group_mask;
     }
 
     return NULL;
 }
 
-// This function creates a new hash map, inserts all elements of the old one into it and then replaces the old one.
-// It returns false on a allocation failiure
-static bool json__hash_map_grow(struct json__hash_map *hm) {
-    size_t new_cap = hm->bucket_cap * JSON_GROWTH_FACTOR;
-    struct json__hash_map_entry *bucket = JSON_CALLOC(new_cap, sizeof(*bucket));
-    struct json__hash_map_entry *collisions = JSON_CALLOC(new_cap, sizeof(*collisions));
-    struct json__hash_map new_hm = {
-        .bucket = bucket,
-        .bucket_cap = new_cap,
+// NOTE: Returns NULL if not found
+static struct json__hash_map_entry* json__hash_map_get(struct json__hash_map *hm, struct json_string key) {
+    return json__hash_map_find(hm, key, json__string_hash(key));
+}
+
+// Returns the index of the first empty or deleted slot in the probe sequence of hash
+static size_t json__hash_map_find_free(struct json__hash_map *hm, size_t hash) {
+    size_t group_mask = hm->cap / JSON__GROUP_WIDTH - 1;
+    size_t group = json__hash_h1(hash) & group_mask;
+
+    for (size_t step = 0;; step++) {
+        json__group_mask match = json__group_match_free(&hm->ctrl[group * JSON__GROUP_WIDTH]);
+        if (match != 0) {
+            return group * JSON__GROUP_WIDTH + json__ctz(match);
+        }
+        group = (group + step + 1) & group_mask;
+    }
+}
+
+// Moves all entries into new storage with new_cap slots, this also drops all the tombstones.
+// It returns false on a allocation failiure, the hash map stays valid in that case.
+static bool json__hash_map_rehash(struct json__hash_map *hm, size_t new_cap) {
+    unsigned char *ctrl = JSON_MALLOC(new_cap);
+    struct json__hash_map_entry *entries = JSON_MALLOC(new_cap * sizeof(*entries));
+    if (ctrl == NULL || entries == NULL) {
+        JSON_FREE(ctrl);
+        JSON_FREE(entries);
+        return false;
+    }
+    memset(ctrl, JSON__CTRL_EMPTY, new_cap);
 
-        .collisions = collisions,
-        .collisions_cap = new_cap,
+    struct json__hash_map new_hm = {
+        .ctrl = ctrl,
+        .entries = entries,
+        .cap = new_cap,
+        .size = hm->size,
+        .refs = hm->refs,
     };
 
-    for (size_t i = 0; i < hm->bucket_cap; i++) {
-        struct json__hash_map_entry *entry = &hm->bucket[i];
-        if (json__hash_map_entry_valid(entry)) {
+    for (size_t i = 0; i < hm->cap; i++) {
+        if (!json__hash_map_slot_full(hm, i)) {
             continue;
         }
 
-        if(!json__hash_map_insert(&new_hm, entry->key, entry->value)) {
-            JSON_FREE(bucket);
-            JSON_FREE(collisions);
-            return false;
-        }
-        while (entry->next != NULL) {
-            entry = entry->next;
-            if(!json__hash_map_insert(&new_hm, entry->key, entry->value)) {
-                JSON_FREE(bucket);
-                JSON_FREE(collisions);
-                return false;
-            }
-        }
+        size_t index = json__hash_map_find_free(&new_hm, hm->entries[i].hash);
+        new_hm.ctrl[index] = json__hash_h2(hm->entries[i].hash);
+        new_hm.entries[index] = hm->entries[i];
     }
 
-    json__hm_delete(hm);
+    JSON_FREE(hm->ctrl);
+    JSON_FREE(hm->entries);
     *hm = new_hm;
 
     return true;
 }
 
-static double json__hash_map_load_factor(struct json__hash_map *hm) {
-    return (double)hm->bucket_size / (double)hm->bucket_cap;
+// Appends the entry to a small map, growing the entries up to JSON_SMALL_OBJECT_SIZE
+// Returns false on a allocation failiure
+static bool json__hash_map_small_insert(struct json__hash_map *hm, struct json__hash_map_entry entry) {
+    if (hm->size == hm->cap) {
+        size_t new_cap = hm->cap == 0 ? 4 : hm->cap * 2;
+        if (new_cap > JSON_SMALL_OBJECT_SIZE) {
+            new_cap = JSON_SMALL_OBJECT_SIZE;
+        }
+        struct json__hash_map_entry *entries = JSON_REALLOC(hm->entries, new_cap * sizeof(*entries));
+        if (entries == NULL) {
+            return false;
+        }
+        hm->entries = entries;
+        hm->cap = new_cap;
+    }
+
+    hm->entries[hm->size] = entry;
+    hm->size += 1;
+    return true;
+}
+
+// Makes sure that one more entry can be inserted without going over JSON_MAX_LOAD_FACTOR
+// Returns false on a allocation failiure
+static bool json__hash_map_reserve_one(struct json__hash_map *hm) {
+    if (hm->ctrl == NULL) {
+        if (hm->size < JSON_SMALL_OBJECT_SIZE) {
+            return true;
+        }
+
+        // The small map is full, turn it into a hash map
+        size_t cap = json__hash_map_round_cap(JSON_INITIAL_BUCKET_SIZE);
+        while ((double)(hm->size + 1) > (double)cap * JSON_MAX_LOAD_FACTOR) {
+            cap *= 2;
+        }
+        return json__hash_map_rehash(hm, cap);
+    }
+
+    size_t max_used = (size_t)((double)hm->cap * JSON_MAX_LOAD_FACTOR);
+    if (hm->size + hm->tombstones + 1 <= max_used) {
+        return true;
+    }
+
+    // If mostly tombstones are in the way, cleaning them up is enough
+    if ((hm->size + 1) * 2 <= max_used) {
+        return json__hash_map_rehash(hm, hm->cap);
+    }
+
+    size_t new_cap = json__hash_map_round_cap((size_t)((double)hm->cap * JSON_GROWTH_FACTOR));
+    if (new_cap <= hm->cap) {
+        new_cap = hm->cap * 2;
+    }
+    return json__hash_map_rehash(hm, new_cap);
 }
 
-// NOTE: Returns false on allocation failiure
+// NOTE: Returns NULL on allocation failiure, otherwise the new entry
 // The hash map stays valid even if the insert fails
-// The key will be copied. You won't have to keep it alive.
-static bool json__hash_map_insert(struct json__hash_map *hm, struct json_string key, struct json_value value) {
+// The key will be copied, unless it is interned. You won't have to keep it alive.
+// The key must not be in the hash map already.
+static struct json__hash_map_entry* json__hash_map_insert(struct json__hash_map *hm, struct json_string key, size_t hash, struct json_value value) {
+    if (!json__hash_map_reserve_one(hm)) {
+        return NULL;
+    }
+
     bool ok = true;
     struct json__hash_map_entry new_entry = {
-        .key = json_string_copy(key, &ok),
+        .key = json__string_copy_key(key, &ok),
+        .hash = hash,
         .value = value,
     };
 
     if (!ok) {
-        return false;
+        return NULL;
     }
 
-    size_t hash = json__hash(new_entry.key.data, new_entry.key.len);
-    size_t index = hash % hm->bucket_cap;
-    struct json__hash_map_entry *entry = &hm->bucket[index];
-    if (json__hash_map_entry_valid(entry)) {
-        while (entry->next != NULL) {
-            entry = entry->next;
-        }
-
-        if (hm->collisions_cap <= hm->collisions_size+1) {
-            // NOTE: Why sizeof(*ptr)? this way, we can just change the type without having to change each sizeof
-            size_t new_size = hm->collisions_cap * JSON_GROWTH_FACTOR * sizeof(*hm->collisions);
-            struct json__hash_map_entry *new_collisions = JSON_REALLOC(hm->collisions, new_size);
-            if (new_collisions == NULL) {
-                return false;
-            }
-            hm->collisions = new_collisions;
-            hm->collisions_cap = new_size;
+    if (hm->ctrl == NULL) {
+        if (!json__hash_map_small_insert(hm, new_entry)) {
+            json_string_delete(new_entry.key);
+            return NULL;
         }
-
-        hm->collisions[hm->collisions_size] = new_entry;
-        entry->next = &hm->collisions[hm->collisions_size];
-        hm->collisions_size += 1;
-    } else {
-        *entry = new_entry;
+        return &hm->entries[hm->size - 1];
     }
-    hm->bucket_size += 1;
 
-    if (json__hash_map_load_factor(hm) > JSON_MAX_LOAD_FACTOR) {
-        json__hash_map_grow(hm);
+    size_t index = json__hash_map_find_free(hm, hash);
+    if (hm->ctrl[index] == JSON__CTRL_DELETED) {
+        hm->tombstones -= 1;
     }
-    return true;
+    hm->ctrl[index] = json__hash_h2(hash);
+    hm->entries[index] = new_entry;
+    hm->size += 1;
+
+    return &hm->entries[index];
 }
 
 static void json__hash_map_entry_delete(struct json__hash_map_entry* entry) {
@@ -817,11 +3405,13 @@ static void json__hash_map_entry_delete(struct json__hash_map_entry* entry) {
     json_value_delete(entry->value);
 }
 
-// Updates the value at the key. If the key does not exist, false is returned.
+// Updates the value at the key or inserts it, if the key does not exist.
+// Returns false on a allocation failiure
 static bool json__hash_map_set(struct json__hash_map *hm, struct json_string key, struct json_value value) {
-    struct json__hash_map_entry *entry = json__hash_map_get(hm, key);
-    if (entry == false) {
-        return false;
+    size_t hash = json__string_hash(key);
+    struct json__hash_map_entry *entry = json__hash_map_find(hm, key, hash);
+    if (entry == NULL) {
+        return json__hash_map_insert(hm, key, hash, value) != NULL;
     }
 
     json_value_delete(entry->value);
@@ -833,110 +3423,98 @@ static bool json__hash_map_set(struct json__hash_map *hm, struct json_string key
 
 // Returns false if we could not find the key
 static bool json__hash_map_delete(struct json__hash_map *hm, struct json_string key) {
-    size_t hash = json__hash(key.data, key.len);
-    size_t index = hash % hm->bucket_cap;
-    struct json__hash_map_entry *entry = &hm->bucket[index];
-
-    if (json__string_eq(entry->key, key)) {
-        json__hash_map_entry_delete(entry);
-        if (entry->next) {
-            *entry = *entry->next;
-        } else {
-            // Reset the entry to 0
-            *entry = (struct json__hash_map_entry) {0};
-        }
+    struct json__hash_map_entry *entry = json__hash_map_get(hm, key);
+    if (entry == NULL) {
+        return false;
+    }
+
+    size_t index = (size_t)(entry - hm->entries);
+    json__hash_map_entry_delete(entry);
+
+    if (hm->ctrl == NULL) {
+        // Keep the insertion order
+        memmove(entry, entry + 1, (hm->size - index - 1) * sizeof(*entry));
+        hm->size -= 1;
         return true;
     }
 
-    while (entry->next != NULL) {
-        if (json__string_eq(entry->next->key, key)) {
-            // NOTE: This leaves a unused slot over. It will be removed when we resize the hash map
-            json__hash_map_entry_delete(entry->next);
-            entry->next = entry->next->next;
-            return true;
-        }
-        entry = entry->next;
+    // If the group still has a empty slot, no probe sequence continued past it, so the slot can become empty again
+    size_t group = index / JSON__GROUP_WIDTH;
+    if (json__group_match(&hm->ctrl[group * JSON__GROUP_WIDTH], JSON__CTRL_EMPTY) != 0) {
+        hm->ctrl[index] = JSON__CTRL_EMPTY;
+    } else {
+        hm->ctrl[index] = JSON__CTRL_DELETED;
+        hm->tombstones += 1;
     }
+    hm->size -= 1;
 
-    return false;
+    return true;
 }
 
-static struct json__hash_map *json__hash_map_copy(struct json__hash_map *hm) {
-    struct json__hash_map_entry *bucket = JSON_CALLOC(hm->bucket_cap, sizeof(*bucket));
-    if (bucket == NULL) {
-        return NULL;
-    }
-    struct json__hash_map_entry *collisions = JSON_CALLOC(hm->bucket_cap, sizeof(*collisions));
-    if (collisions == NULL) {
-        JSON_FREE(bucket);
+// Copies the map with its keys, the values are copied with json_value_share if share is set, otherwise with json_value_copy.
+// Returns NULL on a allocation failiure
+static struct json__hash_map *json__hash_map_copy(struct json__hash_map *hm, bool share) {
+    struct json__hash_map *ptr = JSON_MALLOC(sizeof(*ptr));
+    unsigned char *ctrl = hm->ctrl == NULL ? NULL : JSON_MALLOC(hm->cap);
+    struct json__hash_map_entry *entries = hm->cap == 0 ? NULL : JSON_MALLOC(hm->cap * sizeof(*entries));
+    if (ptr == NULL || (ctrl == NULL && hm->ctrl != NULL) || (entries == NULL && hm->cap != 0)) {
+        JSON_FREE(ptr);
+        JSON_FREE(ctrl);
+        JSON_FREE(entries);
         return NULL;
     }
-    struct json__hash_map new_hm = {
-        .bucket = bucket,
-        .bucket_cap = hm->bucket_cap,
-        .bucket_size = hm->bucket_size,
 
-        .collisions = collisions,
-        .collisions_cap = hm->bucket_cap,
-        .collisions_size = hm->collisions_size,
+    if (ctrl != NULL) {
+        memcpy(ctrl, hm->ctrl, hm->cap);
+    }
+    *ptr = (struct json__hash_map) {
+        .ctrl = ctrl,
+        .entries = entries,
+        .cap = hm->cap,
+        .size = hm->size,
+        .tombstones = hm->tombstones,
+        .refs = 1,
     };
 
-    bool ok = false;
-    for (size_t i = 0; i < hm->bucket_cap; i++) {
-        new_hm.bucket[i] = json__hash_map_entry_copy(hm->bucket[i], new_hm.collisions, hm->collisions, &ok);
-        if (!ok) {
-            json__hm_delete(&new_hm);
-            return NULL;
+    bool ok = true;
+    for (size_t i = 0; i < hm->cap; i++) {
+        if (!json__hash_map_slot_full(hm, i)) {
+            continue;
         }
-    }
 
-    for (size_t i = 0; i < hm->collisions_size; i++) {
-        new_hm.collisions[i] = json__hash_map_entry_copy(hm->collisions[i], new_hm.collisions, hm->collisions, &ok);
+        ptr->entries[i] = json__hash_map_entry_copy(hm->entries[i], share, &ok);
         if (!ok) {
-            json__hm_delete(&new_hm);
+            // Mark everything we did not copy yet as empty, so that json__hm_delete only frees the copied entries
+            if (ptr->ctrl == NULL) {
+                ptr->size = i;
+            } else {
+                memset(&ptr->ctrl[i], JSON__CTRL_EMPTY, hm->cap - i);
+            }
+            json__hm_delete(ptr);
             return NULL;
         }
     }
 
-    struct json__hash_map *ptr = JSON_MALLOC(sizeof(*ptr));
-    if (ptr == NULL) {
-        json__hm_delete(&new_hm);
-        return NULL;
-    }
-    *ptr = new_hm;
     return ptr;
 }
 
-static struct json__hash_map_entry json__hash_map_entry_copy(struct json__hash_map_entry entry, struct json__hash_map_entry *new_collisions, struct json__hash_map_entry *old_collisions, bool *ok) {
-    if (!json__hash_map_entry_valid(&entry)) {
-        return (struct json__hash_map_entry) {0};
-    }
-
-    *ok = true;
-
-    struct json__hash_map_entry new_entry = {0};
-
-    if (entry.next != NULL) {
-        // Because next is a pointer, we need to get it's actual index in the collisions array and then add that back to the new collisons array
-        new_entry.next = (entry.next - old_collisions) + new_collisions;
-    }
+static struct json__hash_map_entry json__hash_map_entry_copy(struct json__hash_map_entry entry, bool share, bool *ok) {
+    struct json__hash_map_entry new_entry = {
+        .hash = entry.hash,
+    };
 
-    new_entry.key = json_string_copy(entry.key, ok);
+    new_entry.key = json__string_copy_key(entry.key, ok);
     if (!*ok) {
         return new_entry;
     }
 
-    new_entry.value = json_value_copy(entry.value, ok);
+    new_entry.value = share ? json_value_share(entry.value, ok) : json_value_copy(entry.value, ok);
     if (!*ok) {
         json_string_delete(new_entry.key);
     }
     return new_entry;
 }
 
-static bool json__hash_map_entry_valid(struct json__hash_map_entry *entry) {
-    return entry->value.type != JSON_INVALID;
-}
-
 #endif // JSON_IMPLEMENTATION
 
 #endif // JSON_H_INC
@@ -0,0 +1,413 @@
+// Throughput benchmark for json.h
+//
+// Usage: json_bench [file.json ...]
+// Without files, only the synthetic object, array, path and NDJSON benchmarks are run. With files (for example twitter.json,
+// canada.json and citm_catalog.json from the usual json benchmark corpus), the parse throughput is measured for each of them.
+// Build with -DJSON_PTHREADS -pthread to also measure json_ndjson_parse with multiple threads.
+
+#define _POSIX_C_SOURCE 199309L
+#define JSON_IMPLEMENTATION
+#include "json.h"
+
+#include <stdio.h>
+#include <time.h>
+
+// Every benchmark is repeated until it ran for at least this long
+#define BENCH_MIN_SECONDS 0.5
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void report_ops(char const *name, size_t ops, double seconds) {
+    printf("%-40s %10.1f ns/op %12.0f ops/s\n", name, seconds * 1e9 / (double)ops, (double)ops / seconds);
+}
+
+static void report_bytes(char const *name, size_t bytes, double seconds) {
+    printf("%-40s %10.1f MB/s\n", name, (double)bytes / seconds / 1e6);
+}
+
+static void check(bool ok, char const *what) {
+    if (!ok) {
+        fprintf(stderr, "%s failed\n", what);
+        exit(1);
+    }
+}
+
+static struct json_string *make_keys(size_t count) {
+    struct json_string *keys = malloc(count * sizeof(*keys));
+    check(keys != NULL, "malloc");
+    for (size_t i = 0; i < count; i++) {
+        char buffer[32];
+        int len = snprintf(buffer, sizeof(buffer), "field_%zu", i);
+        bool ok;
+        keys[i] = json_string_create((unsigned char *)buffer, (size_t)len, &ok);
+        check(ok, "json_string_create");
+    }
+    return keys;
+}
+
+static void delete_keys(struct json_string *keys, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        json_string_delete(keys[i]);
+    }
+    free(keys);
+}
+
+// Builds many objects with key_count keys each, the total amount of inserts is about the same for every key_count
+static void bench_objects(size_t key_count, bool intern) {
+    size_t object_count = 1000000 / key_count + 1;
+    struct json_string *keys = make_keys(key_count);
+    struct json_object *objects = malloc(object_count * sizeof(*objects));
+    check(objects != NULL, "malloc");
+    bool ok;
+
+    struct json_key_table table = json_key_table_create(&ok);
+    check(ok, "json_key_table_create");
+    if (intern) {
+        for (size_t k = 0; k < key_count; k++) {
+            // The table makes its own copy, the interned key replaces ours
+            struct json_string interned = json_key_table_intern(&table, keys[k], &ok);
+            check(ok, "json_key_table_intern");
+            json_string_delete(keys[k]);
+            keys[k] = interned;
+        }
+    }
+
+    char name[64];
+    char const *suffix = intern ? ", interned" : "";
+    size_t ops = object_count * key_count;
+
+    double start = now();
+    for (size_t i = 0; i < object_count; i++) {
+        objects[i] = json_object_create(&ok);
+        check(ok, "json_object_create");
+    }
+    snprintf(name, sizeof(name), "object create (%zu keys%s)", key_count, suffix);
+    report_ops(name, object_count, now() - start);
+
+    start = now();
+    for (size_t i = 0; i < object_count; i++) {
+        for (size_t k = 0; k < key_count; k++) {
+            check(json_object_set(&objects[i], keys[k], json_number((double)k)), "json_object_set");
+        }
+    }
+    snprintf(name, sizeof(name), "object insert (%zu keys%s)", key_count, suffix);
+    report_ops(name, ops, now() - start);
+
+    start = now();
+    double sum = 0;
+    for (size_t i = 0; i < object_count; i++) {
+        for (size_t k = 0; k < key_count; k++) {
+            bool found;
+            sum += json_object_get(&objects[i], keys[k], &found).data.number;
+        }
+    }
+    snprintf(name, sizeof(name), "object lookup (%zu keys%s)", key_count, suffix);
+    report_ops(name, ops, now() - start);
+    check(sum > 0 || key_count == 1, "lookup");
+
+    start = now();
+    for (size_t i = 0; i < object_count; i++) {
+        struct json_object copy = json_object_copy(objects[i], &ok);
+        check(ok, "json_object_copy");
+        json_object_delete(copy);
+    }
+    snprintf(name, sizeof(name), "object copy+delete (%zu keys%s)", key_count, suffix);
+    report_ops(name, object_count, now() - start);
+
+    start = now();
+    for (size_t i = 0; i < object_count; i++) {
+        struct json_value copy = json_value_share(json_object_to_value(objects[i]), &ok);
+        check(ok, "json_value_share");
+        json_value_delete(copy);
+    }
+    snprintf(name, sizeof(name), "object share+delete (%zu keys%s)", key_count, suffix);
+    report_ops(name, object_count, now() - start);
+
+    start = now();
+    for (size_t i = 0; i < object_count; i++) {
+        json_object_delete(objects[i]);
+    }
+    snprintf(name, sizeof(name), "object delete (%zu keys%s)", key_count, suffix);
+    report_ops(name, object_count, now() - start);
+
+    free(objects);
+    // Deleting interned keys does nothing, they are owned by the table
+    delete_keys(keys, key_count);
+    json_key_table_delete(table);
+}
+
+static void bench_arrays(void) {
+    size_t count = 1000000;
+
+    double start = now();
+    struct json_array arr = json_array_create();
+    for (size_t i = 0; i < count; i++) {
+        check(json_array_push(&arr, json_number((double)i)), "json_array_push");
+    }
+    report_ops("array push", count, now() - start);
+
+    start = now();
+    bool ok;
+    struct json_value copy = json_value_copy(json_array_to_value(arr), &ok);
+    check(ok, "json_value_copy");
+    report_ops("array copy (per item)", count, now() - start);
+
+    start = now();
+    json_value_delete(copy);
+    json_array_delete(arr);
+    report_ops("array delete (per item, 2 arrays)", count * 2, now() - start);
+}
+
+static unsigned char *read_file(char const *path, size_t *len) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    unsigned char *data = malloc(size > 0 ? (size_t)size : 1);
+    if (data == NULL || fread(data, 1, (size_t)size, file) != (size_t)size) {
+        free(data);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+    *len = (size_t)size;
+    return data;
+}
+
+static void bench_parse(char const *name, unsigned char *input, size_t len) {
+    unsigned char *scratch = malloc(len > 0 ? len : 1);
+    check(scratch != NULL, "malloc");
+    char label[128];
+
+    size_t bytes = 0;
+    double start = now();
+    do {
+        struct json_parse_result result = json_parse(input, len, (struct json_parse_options) {0});
+        check(result.error == JSON_PARSE_OK, "json_parse");
+        json_value_delete(result.value);
+        bytes += len;
+    } while (now() - start < BENCH_MIN_SECONDS);
+    snprintf(label, sizeof(label), "parse %s", name);
+    report_bytes(label, bytes, now() - start);
+
+    // The copy into the scratch buffer is part of the measurement, in situ parsing modifies its input
+    bytes = 0;
+    start = now();
+    do {
+        memcpy(scratch, input, len);
+        struct json_parse_result result = json_parse(scratch, len, (struct json_parse_options) { .flags = JSON_PARSE_IN_SITU });
+        check(result.error == JSON_PARSE_OK, "json_parse in situ");
+        json_value_delete(result.value);
+        bytes += len;
+    } while (now() - start < BENCH_MIN_SECONDS);
+    snprintf(label, sizeof(label), "parse in situ %s", name);
+    report_bytes(label, bytes, now() - start);
+
+    bytes = 0;
+    start = now();
+    do {
+        struct json_tape_result result = json_tape_parse(input, len);
+        check(result.error == JSON_PARSE_OK, "json_tape_parse");
+        json_tape_delete(result.tape);
+        bytes += len;
+    } while (now() - start < BENCH_MIN_SECONDS);
+    snprintf(label, sizeof(label), "tape %s", name);
+    report_bytes(label, bytes, now() - start);
+
+    // Handing one document to a consumer, that modifies the top level
+    struct json_parse_result document = json_parse(input, len, (struct json_parse_options) {0});
+    check(document.error == JSON_PARSE_OK, "json_parse");
+    bool ok;
+    size_t ops = 0;
+    start = now();
+    do {
+        struct json_value copy = json_value_copy(document.value, &ok);
+        check(ok, "json_value_copy");
+        json_value_delete(copy);
+        ops += 1;
+    } while (now() - start < BENCH_MIN_SECONDS);
+    snprintf(label, sizeof(label), "copy+delete %s", name);
+    report_ops(label, ops, now() - start);
+
+    ops = 0;
+    start = now();
+    do {
+        struct json_value copy = json_value_share(document.value, &ok);
+        check(ok, "json_value_share");
+        if (copy.type == JSON_OBJECT) {
+            check(json_object_set(&copy.data.object, JSON_STR("bench"), json_null()), "json_object_set");
+        } else if (copy.type == JSON_ARRAY) {
+            check(json_array_push(&copy.data.array, json_null()), "json_array_push");
+        }
+        json_value_delete(copy);
+        ops += 1;
+    } while (now() - start < BENCH_MIN_SECONDS);
+    snprintf(label, sizeof(label), "share+modify+delete %s", name);
+    report_ops(label, ops, now() - start);
+    json_value_delete(document.value);
+
+    free(scratch);
+}
+
+#define BENCH_RECORD "{\"id\":%zu,\"name\":\"record %zu\",\"score\":%zu.25,\"active\":true,\"tags\":[1,2]}"
+
+// A object with a array of small records, the typical shape of our documents
+static unsigned char *make_records(size_t count, size_t *len) {
+    size_t cap = count * 128 + 64;
+    unsigned char *data = malloc(cap);
+    check(data != NULL, "malloc");
+    size_t pos = (size_t)snprintf((char *)data, cap, "{\"count\":%zu,\"records\":[", count);
+    for (size_t i = 0; i < count; i++) {
+        pos += (size_t)snprintf((char *)data + pos, cap - pos, "%s" BENCH_RECORD, i == 0 ? "" : ",", i, i, i % 100);
+    }
+    pos += (size_t)snprintf((char *)data + pos, cap - pos, "]}");
+    *len = pos;
+    return data;
+}
+
+// The same records, one per line
+static unsigned char *make_ndjson(size_t count, size_t *len) {
+    size_t cap = count * 128 + 16;
+    unsigned char *data = malloc(cap);
+    check(data != NULL, "malloc");
+    size_t pos = 0;
+    for (size_t i = 0; i < count; i++) {
+        pos += (size_t)snprintf((char *)data + pos, cap - pos, BENCH_RECORD "\n", i, i, i % 100);
+    }
+    *len = pos;
+    return data;
+}
+
+// Looks up all fields of random records in a document made by make_records, path_count fields in total
+static void bench_paths(unsigned char *input, size_t len, size_t record_count) {
+    size_t path_count = 1026;
+    char const *fields[] = { "id", "name", "score", "active", "tags/0", "tags/1" };
+    size_t field_count = sizeof(fields) / sizeof(fields[0]);
+    struct json_path *paths = malloc(path_count * sizeof(*paths));
+    struct json_value *values = malloc(path_count * sizeof(*values));
+    bool *found = malloc(path_count * sizeof(*found));
+    check(paths != NULL && values != NULL && found != NULL, "malloc");
+    bool ok;
+    for (size_t i = 0; i < path_count; i++) {
+        char pointer[64];
+        snprintf(pointer, sizeof(pointer), "/records/%zu/%s", (i / field_count * 7919) % record_count, fields[i % field_count]);
+        paths[i] = json_path_compile(pointer, &ok);
+        check(ok, "json_path_compile");
+    }
+
+    struct json_parse_result document = json_parse(input, len, (struct json_parse_options) {0});
+    check(document.error == JSON_PARSE_OK, "json_parse");
+    struct json_tape_result tape = json_tape_parse(input, len);
+    check(tape.error == JSON_PARSE_OK, "json_tape_parse");
+
+    size_t ops = 0;
+    double start = now();
+    do {
+        for (size_t i = 0; i < path_count; i++) {
+            json_path_eval(document.value, &paths[i], &found[i]);
+            check(found[i], "json_path_eval");
+        }
+        ops += path_count;
+    } while (now() - start < BENCH_MIN_SECONDS);
+    report_ops("path eval", ops, now() - start);
+
+    struct json_path_set set = json_path_set_compile(paths, path_count, &ok);
+    check(ok, "json_path_set_compile");
+    ops = 0;
+    start = now();
+    do {
+        json_path_set_eval(document.value, &set, values, found);
+        check(found[0], "json_path_set_eval");
+        ops += path_count;
+    } while (now() - start < BENCH_MIN_SECONDS);
+    report_ops("path set eval (per path)", ops, now() - start);
+    json_path_set_delete(set);
+
+    ops = 0;
+    start = now();
+    do {
+        for (size_t i = 0; i < path_count; i++) {
+            json_node_path(json_tape_root(&tape.tape), &paths[i], &found[i]);
+            check(found[i], "json_node_path");
+        }
+        ops += path_count;
+    } while (now() - start < BENCH_MIN_SECONDS);
+    report_ops("path eval on tape", ops, now() - start);
+
+    json_tape_delete(tape.tape);
+    json_value_delete(document.value);
+    for (size_t i = 0; i < path_count; i++) {
+        json_path_delete(paths[i]);
+    }
+    free(found);
+    free(values);
+    free(paths);
+}
+
+static bool bench_ndjson_callback(void *user, struct json_ndjson_record *record) {
+    check(record->result.error == JSON_PARSE_OK, "json_ndjson_parse record");
+    json_value_delete(record->result.value);
+    *(size_t *)user += 1;
+    return true;
+}
+
+static void bench_ndjson(unsigned char *input, size_t len, size_t record_count, size_t threads) {
+    // Smaller chunks than the default, so that every thread gets some
+    struct json_ndjson_options options = {
+        .threads = threads,
+        .chunk_size = (size_t)1 << 16,
+    };
+    size_t bytes = 0;
+    double start = now();
+    do {
+        size_t records = 0;
+        check(json_ndjson_parse(input, len, options, bench_ndjson_callback, &records) == JSON_PARSE_OK, "json_ndjson_parse");
+        check(records == record_count, "json_ndjson_parse record count");
+        bytes += len;
+    } while (now() - start < BENCH_MIN_SECONDS);
+    char label[64];
+    snprintf(label, sizeof(label), "ndjson (%zu threads)", threads);
+    report_bytes(label, bytes, now() - start);
+}
+
+int main(int argc, char **argv) {
+    size_t key_counts[] = { 1, 4, 8, 16, 64, 1024 };
+    for (size_t i = 0; i < sizeof(key_counts) / sizeof(key_counts[0]); i++) {
+        bench_objects(key_counts[i], false);
+    }
+    bench_objects(8, true);
+    bench_objects(64, true);
+    bench_arrays();
+
+    size_t len;
+    unsigned char *records = make_records(100000, &len);
+    bench_parse("records (synthetic)", records, len);
+    bench_paths(records, len, 100000);
+    free(records);
+
+    records = make_ndjson(100000, &len);
+    bench_ndjson(records, len, 100000, 1);
+#ifdef JSON_PTHREADS
+    bench_ndjson(records, len, 100000, 4);
+#endif // JSON_PTHREADS
+    free(records);
+
+    for (int i = 1; i < argc; i++) {
+        unsigned char *data = read_file(argv[i], &len);
+        if (data == NULL) {
+            fprintf(stderr, "could not read %s\n", argv[i]);
+            return 1;
+        }
+        bench_parse(argv[i], data, len);
+        free(data);
+    }
+
+    return 0;
+}
@@ -0,0 +1,581 @@
+// Fuzz harness for json.h
+//
+// Built with -fsanitize=fuzzer -DJSON_FUZZ_LIBFUZZER, this is a libFuzzer target. Otherwise it has a main, which runs
+// every file given as argument, or stdin if there are none, through the same code. That works with AFL (afl-clang-fast)
+// and for reproducing crashes with any compiler.
+//
+// The first byte of the input modulo 5 selects what is fuzzed:
+//  0: the rest is parsed as json with json_parse (copying and in situ) and json_tape_parse, which have to agree
+//  1: the rest is a list of hash map operations, which are checked against a simple list of keys
+//  2: the rest are newline separated JSON Pointers, evaluated on a fixed document with json_path_eval, json_path_set_eval
+//     and json_node_path, which have to agree
+//  3: the rest is parsed as NDJSON with json_ndjson_parse, with one and with multiple threads, which have to agree
+//  4: the rest is a list of array operations, which are checked against a plain array
+//
+// Build with -DJSON_PTHREADS -pthread to fuzz the threaded NDJSON parser as well.
+
+#define JSON_IMPLEMENTATION
+#include "json.h"
+
+#include <stdio.h>
+
+// Checks the invariants even in release builds, a failure has to crash for the fuzzer to notice it
+#define FUZZ_CHECK(condition) do { if (!(condition)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); abort(); } } while (0)
+
+// Both values have to be the same value inside of the same document, not just equal
+static bool fuzz_same_value(struct json_value first, struct json_value second) {
+    if (first.type != second.type) {
+        return false;
+    }
+    switch (first.type) {
+        case JSON_OBJECT:
+            return first.data.object._hm == second.data.object._hm;
+        case JSON_ARRAY:
+            return first.data.array.items == second.data.array.items && first.data.array.len == second.data.array.len;
+        case JSON_STRING:
+            return first.data.string.data == second.data.string.data && first.data.string.len == second.data.string.len;
+        case JSON_NUMBER:
+            return memcmp(&first.data.number, &second.data.number, sizeof(double)) == 0;
+        case JSON_INTEGER:
+            return first.data.integer == second.data.integer;
+        case JSON_UNSIGNED:
+            return first.data.unsigned_integer == second.data.unsigned_integer;
+        case JSON_BOOLEAN:
+            return first.data.boolean == second.data.boolean;
+        case JSON_NULL:
+        case JSON_INVALID:
+            break;
+    }
+    return true;
+}
+
+// Both values have to have the same content, they may be in different documents
+static bool fuzz_equal_value(struct json_value first, struct json_value second) {
+    if (first.type != second.type) {
+        return false;
+    }
+    switch (first.type) {
+        case JSON_OBJECT: {
+            size_t first_len = 0;
+            struct json_object_iterator it = json_object_iterator_create(&first.data.object);
+            for (struct json_object_entry entry = json_object_iterator_next(&it); entry.found; entry = json_object_iterator_next(&it)) {
+                bool found;
+                struct json_value other = json_object_get(&second.data.object, entry.key, &found);
+                if (!found || !fuzz_equal_value(*entry.value, other)) {
+                    return false;
+                }
+                first_len += 1;
+            }
+            size_t second_len = 0;
+            it = json_object_iterator_create(&second.data.object);
+            while (json_object_iterator_next(&it).found) {
+                second_len += 1;
+            }
+            return first_len == second_len;
+        }
+        case JSON_ARRAY:
+            if (first.data.array.len != second.data.array.len) {
+                return false;
+            }
+            for (size_t i = 0; i < first.data.array.len; i++) {
+                if (!fuzz_equal_value(first.data.array.items[i], second.data.array.items[i])) {
+                    return false;
+                }
+            }
+            return true;
+        case JSON_STRING:
+            return first.data.string.len == second.data.string.len
+                && (first.data.string.len == 0 || memcmp(first.data.string.data, second.data.string.data, first.data.string.len) == 0);
+        default:
+            return fuzz_same_value(first, second);
+    }
+}
+
+// Compares a materialized tape node with the value from json_parse
+static void check_tape_node(struct json_node node, struct json_value value) {
+    bool is_number = value.type == JSON_NUMBER || value.type == JSON_INTEGER || value.type == JSON_UNSIGNED;
+    FUZZ_CHECK(json_node_type(node) == (is_number ? JSON_NUMBER : value.type));
+
+    if (value.type == JSON_ARRAY) {
+        for (size_t i = 0; i < value.data.array.len; i++) {
+            bool found;
+            struct json_node item = json_node_at(node, i, &found);
+            FUZZ_CHECK(found);
+            check_tape_node(item, value.data.array.items[i]);
+        }
+        bool found;
+        json_node_at(node, value.data.array.len, &found);
+        FUZZ_CHECK(!found);
+    }
+
+    if (value.type == JSON_OBJECT) {
+        struct json_object_iterator it = json_object_iterator_create(&value.data.object);
+        for (struct json_object_entry entry = json_object_iterator_next(&it); entry.found; entry = json_object_iterator_next(&it)) {
+            // Duplicate keys have to resolve to the same member as in json_parse
+            bool found;
+            struct json_node member = json_node_get(node, entry.key, &found);
+            FUZZ_CHECK(found);
+            struct json_parse_result materialized = json_node_value(member, (struct json_parse_options) {0});
+            FUZZ_CHECK(materialized.error == JSON_PARSE_OK);
+            FUZZ_CHECK(fuzz_equal_value(materialized.value, *entry.value));
+            json_value_delete(materialized.value);
+            check_tape_node(member, *entry.value);
+        }
+    }
+}
+
+static void fuzz_parse(uint8_t const *data, size_t size) {
+    unsigned char *input = malloc(size + 1);
+    FUZZ_CHECK(input != NULL);
+    memcpy(input, data, size);
+
+    struct json_parse_result copied = json_parse(input, size, (struct json_parse_options) {0});
+    struct json_tape_result tape = json_tape_parse(input, size);
+
+    // The tape checks escape sequences lazily, so it may accept input json_parse rejects, but never the other way around
+    if (copied.error == JSON_PARSE_OK) {
+        FUZZ_CHECK(tape.error == JSON_PARSE_OK);
+    }
+    if (copied.error == JSON_PARSE_OK && tape.error == JSON_PARSE_OK) {
+        check_tape_node(json_tape_root(&tape.tape), copied.value);
+
+        struct json_parse_result materialized = json_node_value(json_tape_root(&tape.tape), (struct json_parse_options) {0});
+        FUZZ_CHECK(materialized.error == JSON_PARSE_OK);
+        FUZZ_CHECK(fuzz_equal_value(materialized.value, copied.value));
+        json_value_delete(materialized.value);
+
+        bool ok;
+        struct json_value copy = json_value_copy(copied.value, &ok);
+        FUZZ_CHECK(ok);
+        json_value_delete(copy);
+    }
+    if (tape.error == JSON_PARSE_OK) {
+        json_tape_delete(tape.tape);
+    }
+
+    bool ok;
+    struct json_key_table keys = json_key_table_create(&ok);
+    FUZZ_CHECK(ok);
+    struct json_parse_result in_situ = json_parse(input, size, (struct json_parse_options) { .flags = JSON_PARSE_IN_SITU, .keys = &keys });
+    FUZZ_CHECK(in_situ.error == copied.error);
+
+    if (copied.error == JSON_PARSE_OK) {
+        json_value_delete(copied.value);
+    }
+    if (in_situ.error == JSON_PARSE_OK) {
+        json_value_delete(in_situ.value);
+    }
+    json_key_table_delete(keys);
+    free(input);
+}
+
+#define FUZZ_MAX_KEYS 512
+
+struct fuzz_model {
+    struct json_string keys[FUZZ_MAX_KEYS];
+    double values[FUZZ_MAX_KEYS];
+    size_t len;
+};
+
+static size_t fuzz_model_find(struct fuzz_model *model, struct json_string key) {
+    for (size_t i = 0; i < model->len; i++) {
+        if (model->keys[i].len == key.len && (key.len == 0 || memcmp(model->keys[i].data, key.data, key.len) == 0)) {
+            return i;
+        }
+    }
+    return model->len;
+}
+
+// Checks that obj has exactly the keys and values of model
+static void fuzz_model_check(struct json_object *obj, struct fuzz_model *model) {
+    size_t count = 0;
+    struct json_object_iterator it = json_object_iterator_create(obj);
+    for (struct json_object_entry entry = json_object_iterator_next(&it); entry.found; entry = json_object_iterator_next(&it)) {
+        size_t index = fuzz_model_find(model, entry.key);
+        FUZZ_CHECK(index < model->len);
+        FUZZ_CHECK(entry.value->data.number == model->values[index]);
+        count += 1;
+    }
+    FUZZ_CHECK(count == model->len);
+}
+
+// Every operation is: op byte, key length byte, key bytes. The key bytes are taken from the input as is.
+// The snapshot is a shared reference to obj, it must not see any of the later modifications.
+static void fuzz_hash_map(uint8_t const *data, size_t size) {
+    bool ok;
+    struct json_object obj = json_object_create(&ok);
+    FUZZ_CHECK(ok);
+    struct fuzz_model model = {0};
+    struct json_value snapshot = json_null();
+    struct fuzz_model snapshot_model = {0};
+
+    size_t pos = 0;
+    double counter = 0;
+    while (pos + 2 <= size) {
+        uint8_t op = data[pos];
+        size_t key_len = data[pos + 1] % 16;
+        pos += 2;
+        if (key_len > size - pos) {
+            key_len = size - pos;
+        }
+        struct json_string key = { .data = (unsigned char *)&data[pos], .len = key_len };
+        pos += key_len;
+
+        size_t index = fuzz_model_find(&model, key);
+        bool found;
+        switch (op % 5) {
+            case 0:
+            case 1:
+                if (index == model.len && model.len == FUZZ_MAX_KEYS) {
+                    break;
+                }
+                counter += 1;
+                FUZZ_CHECK(json_object_set(&obj, key, json_number(counter)));
+                if (index == model.len) {
+                    model.keys[model.len] = key;
+                    model.len += 1;
+                }
+                model.values[index] = counter;
+                break;
+            case 2:
+                FUZZ_CHECK(json_object_del(&obj, key, &found));
+                FUZZ_CHECK(found == (index < model.len));
+                if (index < model.len) {
+                    model.len -= 1;
+                    model.keys[index] = model.keys[model.len];
+                    model.values[index] = model.values[model.len];
+                }
+                break;
+            case 3: {
+                struct json_value value = json_object_get(&obj, key, &found);
+                FUZZ_CHECK(found == (index < model.len));
+                if (found) {
+                    FUZZ_CHECK(value.data.number == model.values[index]);
+                }
+                break;
+            }
+            case 4:
+                json_value_delete(snapshot);
+                snapshot = json_value_share(json_object_to_value(obj), &ok);
+                FUZZ_CHECK(ok);
+                snapshot_model = model;
+                break;
+        }
+    }
+
+    // All keys have to be there, exactly once
+    struct json_object copy = json_object_copy(obj, &ok);
+    FUZZ_CHECK(ok);
+    fuzz_model_check(&copy, &model);
+    if (snapshot.type == JSON_OBJECT) {
+        fuzz_model_check(&snapshot.data.object, &snapshot_model);
+    }
+
+    json_value_delete(snapshot);
+    json_object_delete(copy);
+    json_object_delete(obj);
+}
+
+// A document with nested objects and arrays, keys that need escaping in a pointer and keys that look like indices
+static char const fuzz_path_document[] =
+    "{\"a\":{\"b\":[1,2,{\"c\":null}],\"~\":true,\"/\":\"slash\",\"\":0,\"~1\":-1},"
+    "\"0\":[\"zero\"],\"01\":1.5,\"list\":[0,1,2,3,4,5,6,7,8,9,10,[11,{\"12\":12}]],"
+    "\"m~n\":{\"a/b\":{\"x\":[]}},\"e\":{},\"u\":\"\\u00e9\"}";
+
+#define FUZZ_MAX_PATHS 32
+
+static void fuzz_path(uint8_t const *data, size_t size) {
+    unsigned char *document = (unsigned char *)fuzz_path_document;
+    size_t document_len = sizeof(fuzz_path_document) - 1;
+    struct json_parse_result parsed = json_parse(document, document_len, (struct json_parse_options) {0});
+    FUZZ_CHECK(parsed.error == JSON_PARSE_OK);
+    struct json_tape_result tape = json_tape_parse(document, document_len);
+    FUZZ_CHECK(tape.error == JSON_PARSE_OK);
+
+    // Every line is one pointer, json_path_compile wants them null terminated
+    char *pointers = malloc(size + 1);
+    FUZZ_CHECK(pointers != NULL);
+    memcpy(pointers, data, size);
+    pointers[size] = '\0';
+
+    struct json_path paths[FUZZ_MAX_PATHS];
+    struct json_value values[FUZZ_MAX_PATHS];
+    bool found[FUZZ_MAX_PATHS];
+    size_t count = 0;
+    char *pointer = pointers;
+    while (pointer != NULL && count < FUZZ_MAX_PATHS) {
+        char *newline = memchr(pointer, '\n', size - (size_t)(pointer - pointers));
+        if (newline != NULL) {
+            *newline = '\0';
+        }
+
+        bool ok;
+        struct json_path path = json_path_compile(pointer, &ok);
+        if (ok) {
+            values[count] = json_path_eval(parsed.value, &path, &found[count]);
+
+            bool node_found;
+            struct json_node node = json_node_path(json_tape_root(&tape.tape), &path, &node_found);
+            FUZZ_CHECK(node_found == found[count]);
+            if (found[count]) {
+                check_tape_node(node, values[count]);
+            }
+
+            paths[count] = path;
+            count += 1;
+        }
+        pointer = newline == NULL ? NULL : newline + 1;
+    }
+
+    struct json_value many_values[FUZZ_MAX_PATHS];
+    bool many_found[FUZZ_MAX_PATHS];
+    bool ok;
+    struct json_path_set set = json_path_set_compile(paths, count, &ok);
+    FUZZ_CHECK(ok);
+    json_path_set_eval(parsed.value, &set, many_values, many_found);
+    json_path_set_delete(set);
+    for (size_t i = 0; i < count; i++) {
+        FUZZ_CHECK(many_found[i] == found[i]);
+        if (found[i]) {
+            FUZZ_CHECK(fuzz_same_value(many_values[i], values[i]));
+        }
+        json_path_delete(paths[i]);
+    }
+
+    free(pointers);
+    json_tape_delete(tape.tape);
+    json_value_delete(parsed.value);
+}
+
+struct fuzz_ndjson_run {
+    size_t *offsets;
+    enum json_parse_error *errors;
+    size_t len;
+    // The callback stops after this many records
+    size_t stop_after;
+};
+
+static bool fuzz_ndjson_callback(void *user, struct json_ndjson_record *record) {
+    struct fuzz_ndjson_run *run = user;
+    // The records have to arrive in order, no matter how many threads parsed them
+    FUZZ_CHECK(record->index == run->len);
+    FUZZ_CHECK(run->len == 0 || record->offset > run->offsets[run->len - 1]);
+    run->offsets[run->len] = record->offset;
+    run->errors[run->len] = record->result.error;
+    run->len += 1;
+    if (record->result.error == JSON_PARSE_OK) {
+        json_value_delete(record->result.value);
+    }
+    return run->len < run->stop_after;
+}
+
+static struct fuzz_ndjson_run fuzz_ndjson_run(unsigned char *input, size_t size, struct json_ndjson_options options, size_t stop_after) {
+    // There can not be more records than lines
+    struct fuzz_ndjson_run run = {
+        .offsets = malloc((size / 2 + 1) * sizeof(size_t)),
+        .errors = malloc((size / 2 + 1) * sizeof(enum json_parse_error)),
+        .stop_after = stop_after,
+    };
+    FUZZ_CHECK(run.offsets != NULL && run.errors != NULL);
+    FUZZ_CHECK(json_ndjson_parse(input, size, options, fuzz_ndjson_callback, &run) == JSON_PARSE_OK);
+    return run;
+}
+
+static void fuzz_ndjson_run_delete(struct fuzz_ndjson_run run) {
+    free(run.offsets);
+    free(run.errors);
+}
+
+// The first byte selects the chunk size, so that records end up in many small chunks
+static void fuzz_ndjson(uint8_t const *data, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    size_t chunk_size = (size_t)data[0] % 64 + 1;
+    unsigned char *input = malloc(size);
+    FUZZ_CHECK(input != NULL);
+    memcpy(input, data + 1, size - 1);
+    size -= 1;
+
+    struct fuzz_ndjson_run single = fuzz_ndjson_run(input, size, (struct json_ndjson_options) { .threads = 1 }, SIZE_MAX);
+    struct fuzz_ndjson_run threaded = fuzz_ndjson_run(input, size, (struct json_ndjson_options) { .threads = 4, .chunk_size = chunk_size }, SIZE_MAX);
+    FUZZ_CHECK(single.len == threaded.len);
+    for (size_t i = 0; i < single.len; i++) {
+        FUZZ_CHECK(single.offsets[i] == threaded.offsets[i]);
+        FUZZ_CHECK(single.errors[i] == threaded.errors[i]);
+
+        // Every record is a line of its own
+        size_t offset = single.offsets[i];
+        FUZZ_CHECK(offset == 0 || input[offset - 1] == '\n');
+        unsigned char *newline = memchr(&input[offset], '\n', size - offset);
+        size_t end = newline == NULL ? size : (size_t)(newline - input);
+        struct json_parse_result line = json_parse(&input[offset], end - offset, (struct json_parse_options) {0});
+        FUZZ_CHECK(line.error == single.errors[i]);
+        if (line.error == JSON_PARSE_OK) {
+            json_value_delete(line.value);
+        }
+    }
+
+    // Stopping early has to delete the records, that were parsed already but not delivered
+    size_t stop_after = single.len / 2 + 1;
+    struct fuzz_ndjson_run stopped = fuzz_ndjson_run(input, size, (struct json_ndjson_options) { .threads = 4, .chunk_size = chunk_size }, stop_after);
+    FUZZ_CHECK(stopped.len == (single.len < stop_after ? single.len : stop_after));
+
+    fuzz_ndjson_run_delete(stopped);
+    fuzz_ndjson_run_delete(threaded);
+    fuzz_ndjson_run_delete(single);
+    free(input);
+}
+
+#define FUZZ_MAX_ITEMS 4096
+
+// Every operation is: op byte, argument byte. The array and the shared snapshot are checked against plain arrays.
+static void fuzz_array(uint8_t const *data, size_t size) {
+    struct json_array arr = json_array_create();
+    int64_t *model = malloc(FUZZ_MAX_ITEMS * sizeof(*model));
+    int64_t *snapshot_model = malloc(FUZZ_MAX_ITEMS * sizeof(*snapshot_model));
+    FUZZ_CHECK(model != NULL && snapshot_model != NULL);
+    size_t len = 0;
+    struct json_value snapshot = json_null();
+    size_t snapshot_len = 0;
+    int64_t counter = 0;
+    bool ok;
+
+    for (size_t pos = 0; pos + 2 <= size; pos += 2) {
+        uint8_t op = data[pos];
+        size_t argument = data[pos + 1];
+        switch (op % 6) {
+            case 0:
+                if (len == FUZZ_MAX_ITEMS) {
+                    break;
+                }
+                counter += 1;
+                FUZZ_CHECK(json_array_push(&arr, json_integer(counter)));
+                model[len] = counter;
+                len += 1;
+                break;
+            case 1: {
+                if (len == FUZZ_MAX_ITEMS) {
+                    break;
+                }
+                size_t index = argument % (len + 1);
+                counter += 1;
+                FUZZ_CHECK(json_array_insert(&arr, index, json_integer(counter)));
+                memmove(&model[index + 1], &model[index], (len - index) * sizeof(*model));
+                model[index] = counter;
+                len += 1;
+                break;
+            }
+            case 2: {
+                if (len == 0) {
+                    break;
+                }
+                size_t index = argument % len;
+                struct json_value removed = json_array_remove(&arr, index);
+                FUZZ_CHECK(removed.type == JSON_INTEGER && removed.data.integer == model[index]);
+                memmove(&model[index], &model[index + 1], (len - index - 1) * sizeof(*model));
+                len -= 1;
+                break;
+            }
+            case 3: {
+                if (len == 0) {
+                    break;
+                }
+                struct json_value popped = json_array_pop(&arr);
+                FUZZ_CHECK(popped.type == JSON_INTEGER && popped.data.integer == model[len - 1]);
+                len -= 1;
+                break;
+            }
+            case 4:
+                FUZZ_CHECK(json_array_reserve(&arr, argument));
+                FUZZ_CHECK(json_array_cap(arr) >= len + argument);
+                break;
+            case 5:
+                json_value_delete(snapshot);
+                snapshot = json_value_share(json_array_to_value(arr), &ok);
+                FUZZ_CHECK(ok);
+                memcpy(snapshot_model, model, len * sizeof(*model));
+                snapshot_len = len;
+                break;
+        }
+        FUZZ_CHECK(arr.len == len && arr.len <= json_array_cap(arr));
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        FUZZ_CHECK(arr.items[i].data.integer == model[i]);
+    }
+    if (snapshot.type == JSON_ARRAY) {
+        FUZZ_CHECK(snapshot.data.array.len == snapshot_len);
+        for (size_t i = 0; i < snapshot_len; i++) {
+            FUZZ_CHECK(snapshot.data.array.items[i].data.integer == snapshot_model[i]);
+        }
+    }
+
+    json_value_delete(snapshot);
+    json_array_delete(arr);
+    free(snapshot_model);
+    free(model);
+}
+
+int LLVMFuzzerTestOneInput(uint8_t const *data, size_t size);
+
+int LLVMFuzzerTestOneInput(uint8_t const *data, size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    switch (data[0] % 5) {
+        case 0:
+            fuzz_parse(data + 1, size - 1);
+            break;
+        case 1:
+            fuzz_hash_map(data + 1, size - 1);
+            break;
+        case 2:
+            fuzz_path(data + 1, size - 1);
+            break;
+        case 3:
+            fuzz_ndjson(data + 1, size - 1);
+            break;
+        case 4:
+            fuzz_array(data + 1, size - 1);
+            break;
+    }
+    return 0;
+}
+
+#ifndef JSON_FUZZ_LIBFUZZER
+static int run_file(FILE *file) {
+    size_t cap = 4096;
+    size_t len = 0;
+    uint8_t *data = malloc(cap);
+    FUZZ_CHECK(data != NULL);
+    for (;;) {
+        len += fread(data + len, 1, cap - len, file);
+        if (len < cap) {
+            break;
+        }
+        cap *= 2;
+        data = realloc(data, cap);
+        FUZZ_CHECK(data != NULL);
+    }
+    LLVMFuzzerTestOneInput(data, len);
+    free(data);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        return run_file(stdin);
+    }
+    for (int i = 1; i < argc; i++) {
+        FILE *file = fopen(argv[i], "rb");
+        if (file == NULL) {
+            fprintf(stderr, "could not open %s\n", argv[i]);
+            return 1;
+        }
+        run_file(file);
+        fclose(file);
+    }
+    return 0;
+}
+#endif // JSON_FUZZ_LIBFUZZER
@@ -16,15 +16,30 @@ if (!output) {
 const content = readFileSync(input).toString("utf8");
 const jsonContent = JSON.parse(content)
 
+interface Heap {
+    type: string
+    // Used instead of the type in the name of the heap
+    name: string
+    // A C expression, true if the item at the pointer a has to come out of the heap before the one at b
+    before: string
+    // The amount of children per node
+    arity: number
+}
+
 const arrays: string[] = [];
+const concurrentArrays: string[] = [];
+const heaps: Heap[] = [];
 let header: string = "";
 let configMacros = {
     malloc: "malloc",
     realloc: "realloc",
     free: "free",
-    assert: "assert"
+    assert: "assert",
+    alignedAlloc: "aligned_alloc"
 };
 let prefix = "";
+// The alignment of the items in bytes, 0 uses the normal malloc and realloc
+let align = 0;
 
 for (const key in jsonContent) {
     const content = jsonContent[key]
@@ -40,6 +55,51 @@ for (const key in jsonContent) {
                 }
             }
         }
+    } else if (key === "concurrent_arrays") {
+        if (Array.isArray(content)) {
+            for (let i = 0; i < content.length; i++) {
+                const arrElement = content[i]
+                if (typeof arrElement === "string") {
+                    concurrentArrays.push(arrElement)
+                } else {
+                    console.error(`INVALID ELEMENT IN "${key}", expected string, got ${typeof arrElement}`)
+                    process.exit(1)
+                }
+            }
+        }
+    } else if (key === "heaps") {
+        if (Array.isArray(content)) {
+            for (let i = 0; i < content.length; i++) {
+                const heapElement = content[i]
+                if (typeof heapElement !== "object" || heapElement === null) {
+                    console.error(`INVALID ELEMENT IN "${key}", expected object, got ${typeof heapElement}`)
+                    process.exit(1)
+                }
+                const { type, name, before, arity } = heapElement
+                if (typeof type !== "string") {
+                    console.error(`INVALID TYPE FOR "type" IN "${key}", expected string, got ${typeof type}`)
+                    process.exit(1)
+                }
+                if (typeof before !== "string") {
+                    console.error(`INVALID TYPE FOR "before" IN "${key}", expected string, got ${typeof before}`)
+                    process.exit(1)
+                }
+                if (name !== undefined && typeof name !== "string") {
+                    console.error(`INVALID TYPE FOR "name" IN "${key}", expected string, got ${typeof name}`)
+                    process.exit(1)
+                }
+                if (arity !== undefined && !(typeof arity === "number" && Number.isInteger(arity) && arity >= 2)) {
+                    console.error(`INVALID VALUE FOR "arity" IN "${key}", expected a integer of at least 2, got ${arity}`)
+                    process.exit(1)
+                }
+                heaps.push({
+                    type,
+                    name: name ?? type.replaceAll("*", "_ptr").replaceAll(" ", "_").replaceAll(/_+/g, "_"),
+                    before,
+                    arity: arity ?? 2,
+                })
+            }
+        }
     } else if (key === "header") {
         if (typeof content === "string") {
             header = content;
@@ -75,6 +135,20 @@ for (const key in jsonContent) {
             console.error(`INVALID TYPE FOR "${key}", expected string, got ${typeof content}`)
             process.exit(1)
         }
+    } else if (key === "align") {
+        if (typeof content === "number" && Number.isInteger(content) && content > 0 && (content & (content - 1)) === 0) {
+            align = content;
+        } else {
+            console.error(`INVALID VALUE FOR "${key}", expected a power of two, got ${content}`)
+            process.exit(1)
+        }
+    } else if (key === "aligned_alloc") {
+        if (typeof content === "string") {
+            configMacros.alignedAlloc = content;
+        } else {
+            console.error(`INVALID TYPE FOR "${key}", expected string, got ${typeof content}`)
+            process.exit(1)
+        }
     } else if (key === "assert") {
         if (typeof content === "string") {
             configMacros.assert = content;
@@ -88,10 +162,17 @@ for (const key in jsonContent) {
     }
 }
 
+// _seal returns a slice and heaps store their items in a array, so they need the normal array as well
+for (const e of [...concurrentArrays, ...heaps.map(heap => heap.type)]) {
+    if (!arrays.includes(e)) {
+        arrays.push(e)
+    }
+}
+
 let outputText = `
 #include <stddef.h>
 #include <stdlib.h>
-#include <assert.h>
+#include <assert.h>${concurrentArrays.length > 0 ? "\n#include <stdatomic.h>\n#include <stdbool.h>" : ""}
 
 // Header Begin
 ${header}
@@ -105,6 +186,53 @@ enum array_err {
 typedef enum array_err array_err;
 `
 
+const alignMacro = (prefix + "array_align").toUpperCase();
+const alignedAlloc = prefix + "array_aligned_alloc";
+
+if (align > 0) {
+    outputText += `
+#define ${alignMacro} ${align}
+
+// Allocates size bytes aligned to ${alignMacro}, the memory is freed with ${configMacros.free}.
+static inline void *${alignedAlloc}(size_t size) {
+    // aligned_alloc wants a multiple of the alignment
+    return ${configMacros.alignedAlloc}(${alignMacro}, (size + ${alignMacro} - 1) / ${alignMacro} * ${alignMacro});
+}
+`
+}
+
+// Allocates size bytes for items, honoring align
+function allocItems(size: string): string {
+    return align > 0 ? `${alignedAlloc}(${size})` : `${configMacros.malloc}(${size})`
+}
+
+// Shared by every concurrent array, prefixed so two generated files can be included together
+const concurrentSegments = (prefix + "array_concurrent_segments").toUpperCase();
+const concurrentLocate = prefix + "array_concurrent_locate";
+
+if (concurrentArrays.length > 0) {
+    outputText += `
+// Concurrent arrays store their items in segments, which double in size. Segment k holds (1 << shift) << k items.
+#define ${concurrentSegments} 64
+
+// Finds the segment of the item at index and its offset in that segment.
+static inline void ${concurrentLocate}(size_t index, size_t shift, size_t *segment, size_t *offset) {
+    // The items before segment k are ((1 << k) - 1) << shift, so (index >> shift) + 1 has k as its highest bit
+    size_t biased = (index >> shift) + 1;
+#if defined(__GNUC__)
+    size_t k = sizeof(unsigned long long) * 8 - 1 - (size_t)__builtin_clzll(biased);
+#else
+    size_t k = 0;
+    while ((biased >> (k + 1)) != 0) {
+        k += 1;
+    }
+#endif
+    *segment = k;
+    *offset = index - ((((size_t)1 << k) - 1) << shift);
+}
+`
+}
+
 for (let i = 0; i < arrays.length; i++) {
     const e = arrays[i]
     if (!e) {
@@ -141,17 +269,25 @@ void ${arrayName}_delete(${arrayName} arr) {
 
 array_err ${arrayName}_grow(${arrayName} *arr) {
     if (arr->items == NULL) {
-        arr->items = ${configMacros.malloc}(sizeof(arr->items[0]) * ${initialSize});
+        arr->items = ${allocItems(`sizeof(arr->items[0]) * ${initialSize}`)};
         if (arr->items == NULL) {
             return ARRAY_OOM;
         }
         arr->cap = ${initialSize};
     } else {
-        size_t new_cap = sizeof(arr->items[0]) * arr->cap * 2;
-        ${e}* items = ${configMacros.realloc}(arr->items, new_cap);
-        if (arr->items == NULL) {
+        size_t new_cap = arr->cap * 2;
+${align > 0 ? `        // realloc does not keep the alignment
+        ${e}* items = ${alignedAlloc}(sizeof(arr->items[0]) * new_cap);
+        if (items == NULL) {
             return ARRAY_OOM;
         }
+        for (size_t i = 0; i < arr->len; i++) {
+            items[i] = arr->items[i];
+        }
+        ${configMacros.free}(arr->items);` : `        ${e}* items = ${configMacros.realloc}(arr->items, sizeof(arr->items[0]) * new_cap);
+        if (items == NULL) {
+            return ARRAY_OOM;
+        }`}
         arr->items = items;
         arr->cap = new_cap;
     }
@@ -198,6 +334,19 @@ array_err ${arrayName}_append(${arrayName} *arr, ${sliceName} slice) {
 
 #define ${arrayNameUpperCase}_APPEND(arr, ...) ${arrayName}_append((arr), (${sliceName}){ .items = (${e}[]) { __VA_ARGS__ }, .len = sizeof((${e}[]){ __VA_ARGS__ }[0]) })
 
+// Adds a uninitialized item to the end of the array and returns a pointer to it, so large items can be written in place.
+// The pointer is valid until the array grows. Returns NULL if growing the array failed.
+${e} *${arrayName}_emplace(${arrayName} *arr) {
+    if (arr->cap <= arr->len) {
+        array_err err = ${arrayName}_grow_until(arr, arr->len + 1);
+        if (err != ARRAY_OK) {
+            return NULL;
+        }
+    }
+    arr->len += 1;
+    return &arr->items[arr->len - 1];
+}
+
 
 void ${arrayName}_unordered_remove(${arrayName} *arr, size_t at) {
     assert(0 <= at && at < arr->len);
@@ -235,6 +384,18 @@ ${e} ${arrayName}_set(${arrayName} *arr, size_t at, ${e} value) {
     return old_value;
 }
 
+// The pointer is valid until the array grows or the item is removed
+${e} *${arrayName}_get_ptr(${arrayName} *arr, size_t at) {
+    assert(at < arr->len);
+    return &arr->items[at];
+}
+
+// Copies *value into the item at, unlike _set the old value is not returned
+void ${arrayName}_set_ptr(${arrayName} *arr, size_t at, ${e} const *value) {
+    assert(at < arr->len);
+    arr->items[at] = *value;
+}
+
 // IMPORTANT: This slice is not owned, it has the same lifetime as the original array
 ${sliceName} ${arrayName}_slice(${arrayName} *arr, size_t from, size_t to) {
     assert(0 <= from);
@@ -258,7 +419,7 @@ ${sliceName} ${sliceName}_slice(${sliceName} *slice, size_t from, size_t to) {
 }
 
 array_err ${arrayName}_to_owned_slice(${arrayName} *arr, ${sliceName} *dst) {
-    ${e} *new_slice = ${configMacros.malloc}(sizeof(${e}) * arr->len);
+    ${e} *new_slice = ${allocItems(`sizeof(${e}) * arr->len`)};
 
     if (new_slice == NULL) {
         return ARRAY_OOM;
@@ -292,9 +453,330 @@ ${e} ${sliceName}_set(${sliceName} *slice, size_t at, ${e} value) {
     return old_value;
 }
 
+${e} *${sliceName}_get_ptr(${sliceName} *slice, size_t at) {
+    assert(at < slice->len);
+    return &slice->items[at];
+}
+
+void ${sliceName}_set_ptr(${sliceName} *slice, size_t at, ${e} const *value) {
+    assert(at < slice->len);
+    slice->items[at] = *value;
+}
+
 // End ${e}
 `
 }
 
+for (let i = 0; i < concurrentArrays.length; i++) {
+    const e = concurrentArrays[i]
+    if (!e) {
+        throw new Error("Invalid JavaScript Array, should not happen.");
+    }
+    const niceName = e.replaceAll("*", "_ptr").replaceAll(" ", "_").replaceAll(/_+/g, "_")
+    const arrayName = prefix + "array_" + niceName + "_concurrent";
+    const arrayNameUpperCase = arrayName.toUpperCase();
+    const sliceName = prefix + "slice_" + niceName;
+
+    outputText +=
+        `
+// Begin ${e} concurrent
+
+// Many threads can push and append at the same time. Every push reserves its slot with one atomic add, the items are stored
+// in segments that never move, so growing does not block the other threads. Once all producers are done, _seal turns it into a slice.
+// A zero initialized array is valid, _init makes the first segment large enough for the expected amount of items.
+struct ${arrayName} {
+    _Atomic size_t len;
+    // The first segment holds 1 << shift items, do not change it after the first push
+    size_t shift;
+    // A push or append could not allocate its segment, the reserved slots are missing
+    atomic_bool oom;
+    ${e} *_Atomic segments[${concurrentSegments}];
+};
+
+typedef struct ${arrayName} ${arrayName};
+
+// Frees all segments, the array is empty afterwards and can be reused.
+// IMPORTANT: Not thread safe, all producers have to be done.
+void ${arrayName}_delete(${arrayName} *arr) {
+    for (size_t k = 0; k < ${concurrentSegments}; k++) {
+        ${configMacros.free}(atomic_load(&arr->segments[k]));
+        atomic_store(&arr->segments[k], NULL);
+    }
+    atomic_store(&arr->len, 0);
+    atomic_store(&arr->oom, false);
+}
+
+// Returns segment k, it is allocated if no other thread did that yet. Returns NULL if the allocation failed.
+${e} *${arrayName}_segment(${arrayName} *arr, size_t k) {
+    ${e} *segment = atomic_load_explicit(&arr->segments[k], memory_order_acquire);
+    if (segment != NULL) {
+        return segment;
+    }
+
+    ${e} *new_segment = ${allocItems(`sizeof(${e}) * ((size_t)1 << arr->shift << k)`)};
+    if (new_segment == NULL) {
+        return NULL;
+    }
+    if (atomic_compare_exchange_strong_explicit(&arr->segments[k], &segment, new_segment, memory_order_acq_rel, memory_order_acquire)) {
+        return new_segment;
+    }
+    // Another thread was faster, segment is its allocation now
+    ${configMacros.free}(new_segment);
+    return segment;
+}
+
+// Allocates all segments up to the item at until - 1, so pushing that many items does not allocate.
+array_err ${arrayName}_reserve(${arrayName} *arr, size_t until) {
+    if (until == 0) {
+        return ARRAY_OK;
+    }
+    size_t last, offset;
+    ${concurrentLocate}(until - 1, arr->shift, &last, &offset);
+    for (size_t k = 0; k <= last; k++) {
+        if (${arrayName}_segment(arr, k) == NULL) {
+            return ARRAY_OOM;
+        }
+    }
+    return ARRAY_OK;
+}
+
+// IMPORTANT: Not thread safe, call it before the producers start.
+array_err ${arrayName}_init(${arrayName} *arr, size_t expected) {
+    size_t shift = 0;
+    while (((size_t)1 << shift) < expected && shift < sizeof(size_t) * 8 - 1) {
+        shift += 1;
+    }
+    atomic_init(&arr->len, 0);
+    atomic_init(&arr->oom, false);
+    arr->shift = shift;
+    for (size_t k = 0; k < ${concurrentSegments}; k++) {
+        atomic_init(&arr->segments[k], NULL);
+    }
+    return ${arrayName}_reserve(arr, expected);
+}
+
+// The amount of reserved slots, items pushed by other threads may not be written yet.
+size_t ${arrayName}_len(${arrayName} *arr) {
+    return atomic_load_explicit(&arr->len, memory_order_relaxed);
+}
+
+array_err ${arrayName}_push(${arrayName} *arr, ${e} item) {
+    size_t index = atomic_fetch_add_explicit(&arr->len, 1, memory_order_relaxed);
+    size_t segment, offset;
+    ${concurrentLocate}(index, arr->shift, &segment, &offset);
+    ${e} *items = ${arrayName}_segment(arr, segment);
+    if (items == NULL) {
+        atomic_store(&arr->oom, true);
+        return ARRAY_OOM;
+    }
+    items[offset] = item;
+    return ARRAY_OK;
+}
+
+// The items of slice stay together, items of other threads are never in between.
+array_err ${arrayName}_append(${arrayName} *arr, ${sliceName} slice) {
+    size_t index = atomic_fetch_add_explicit(&arr->len, slice.len, memory_order_relaxed);
+    size_t i = 0;
+    while (i < slice.len) {
+        size_t segment, offset;
+        ${concurrentLocate}(index + i, arr->shift, &segment, &offset);
+        ${e} *items = ${arrayName}_segment(arr, segment);
+        if (items == NULL) {
+            atomic_store(&arr->oom, true);
+            return ARRAY_OOM;
+        }
+        size_t segment_cap = (size_t)1 << arr->shift << segment;
+        for (; i < slice.len && offset < segment_cap; i++, offset++) {
+            items[offset] = slice.items[i];
+        }
+    }
+    return ARRAY_OK;
+}
+
+#define ${arrayNameUpperCase}_APPEND(arr, ...) ${arrayName}_append((arr), (${sliceName}){ .items = (${e}[]) { __VA_ARGS__ }, .len = sizeof((${e}[]){ __VA_ARGS__ }) / sizeof(${e}) })
+
+// Moves all items into dst, which has to be freed with ${sliceName}_delete_owned. The array is empty afterwards.
+// If all items fit into the first segment, it becomes the slice without copying.
+// Returns ARRAY_OOM if a push or append failed before, the items are lost in that case, or if the copy could not be allocated.
+// IMPORTANT: Not thread safe, all producers have to be done.
+array_err ${arrayName}_seal(${arrayName} *arr, ${sliceName} *dst) {
+    size_t len = atomic_load(&arr->len);
+    if (atomic_load(&arr->oom)) {
+        ${arrayName}_delete(arr);
+        return ARRAY_OOM;
+    }
+
+    ${e} *items;
+    if (len <= ((size_t)1 << arr->shift)) {
+        items = atomic_exchange(&arr->segments[0], NULL);
+    } else {
+        items = ${allocItems(`sizeof(${e}) * len`)};
+        if (items == NULL) {
+            return ARRAY_OOM;
+        }
+        size_t copied = 0;
+        for (size_t k = 0; copied < len; k++) {
+            ${e} *segment = atomic_load(&arr->segments[k]);
+            size_t segment_cap = (size_t)1 << arr->shift << k;
+            for (size_t i = 0; i < segment_cap && copied < len; i++, copied++) {
+                items[copied] = segment[i];
+            }
+        }
+    }
+
+    ${arrayName}_delete(arr);
+    *dst = (${sliceName}){
+        .items = items,
+        .len = len,
+    };
+    return ARRAY_OK;
+}
+
+// End ${e} concurrent
+`
+}
+
+for (let i = 0; i < heaps.length; i++) {
+    const heap = heaps[i]
+    if (!heap) {
+        throw new Error("Invalid JavaScript Array, should not happen.");
+    }
+    const e = heap.type
+    const niceName = e.replaceAll("*", "_ptr").replaceAll(" ", "_").replaceAll(/_+/g, "_")
+    const arrayName = prefix + "array_" + niceName;
+    const sliceName = prefix + "slice_" + niceName;
+    const heapName = prefix + "heap_" + heap.name;
+    const d = heap.arity;
+
+    outputText +=
+        `
+// Begin heap ${heap.name}
+
+// A priority queue, the item that comes before all others is at the top.
+// The items are stored as a implicit ${d}-ary tree in a ${arrayName}, the children of items[i] are items[i * ${d} + 1] to items[i * ${d} + ${d}].
+// A zero initialized heap is valid.
+struct ${heapName} {
+    ${arrayName} arr;
+};
+
+typedef struct ${heapName} ${heapName};
+
+// Returns true if a has to come out of the heap before b
+static inline int ${heapName}_before(${e} const *a, ${e} const *b) {
+    return ${heap.before};
+}
+
+void ${heapName}_delete(${heapName} heap) {
+    ${arrayName}_delete(heap.arr);
+}
+
+size_t ${heapName}_len(${heapName} *heap) {
+    return heap->arr.len;
+}
+
+// Moves the item at at up, until its parent comes before it
+void ${heapName}_sift_up(${heapName} *heap, size_t at) {
+    ${e} *items = heap->arr.items;
+    ${e} item = items[at];
+    while (at > 0) {
+        size_t parent = (at - 1) / ${d};
+        if (!${heapName}_before(&item, &items[parent])) {
+            break;
+        }
+        items[at] = items[parent];
+        at = parent;
+    }
+    items[at] = item;
+}
+
+// Moves the item at at down, until it comes before all of its children
+void ${heapName}_sift_down(${heapName} *heap, size_t at) {
+    ${e} *items = heap->arr.items;
+    size_t len = heap->arr.len;
+    ${e} item = items[at];
+    for (;;) {
+        size_t first = at * ${d} + 1;
+        if (first >= len) {
+            break;
+        }
+        size_t end = len - first < ${d} ? len : first + ${d};
+        size_t best = first;
+        for (size_t child = first + 1; child < end; child++) {
+            if (${heapName}_before(&items[child], &items[best])) {
+                best = child;
+            }
+        }
+        if (!${heapName}_before(&items[best], &item)) {
+            break;
+        }
+        items[at] = items[best];
+        at = best;
+    }
+    items[at] = item;
+}
+
+array_err ${heapName}_push(${heapName} *heap, ${e} item) {
+    array_err err = ${arrayName}_push(&heap->arr, item);
+    if (err != ARRAY_OK) {
+        return err;
+    }
+    ${heapName}_sift_up(heap, heap->arr.len - 1);
+    return ARRAY_OK;
+}
+
+${e} ${heapName}_peek(${heapName} *heap) {
+    assert(heap->arr.len > 0);
+    return heap->arr.items[0];
+}
+
+${e} ${heapName}_pop_top(${heapName} *heap) {
+    assert(heap->arr.len > 0);
+    ${e} top = heap->arr.items[0];
+    heap->arr.len -= 1;
+    if (heap->arr.len > 0) {
+        heap->arr.items[0] = heap->arr.items[heap->arr.len];
+        ${heapName}_sift_down(heap, 0);
+    }
+    return top;
+}
+
+// Replaces the top with item and returns the old top, this is cheaper than a _pop_top followed by a _push.
+${e} ${heapName}_replace_top(${heapName} *heap, ${e} item) {
+    assert(heap->arr.len > 0);
+    ${e} top = heap->arr.items[0];
+    heap->arr.items[0] = item;
+    ${heapName}_sift_down(heap, 0);
+    return top;
+}
+
+// Replaces the item at the index at with item, which may not come after the old item.
+// IMPORTANT: Indices change with every modification of the heap.
+void ${heapName}_decrease_key(${heapName} *heap, size_t at, ${e} item) {
+    assert(at < heap->arr.len);
+    assert(!${heapName}_before(&heap->arr.items[at], &item));
+    heap->arr.items[at] = item;
+    ${heapName}_sift_up(heap, at);
+}
+
+// Adds all items of slice and restores the heap order in O(n), instead of the O(n log n) of pushing them one by one.
+array_err ${heapName}_heapify_from_slice(${heapName} *heap, ${sliceName} slice) {
+    array_err err = ${arrayName}_append(&heap->arr, slice);
+    if (err != ARRAY_OK) {
+        return err;
+    }
+    if (heap->arr.len < 2) {
+        return ARRAY_OK;
+    }
+    // Start at the last item with children
+    for (size_t i = (heap->arr.len - 2) / ${d} + 1; i > 0; i--) {
+        ${heapName}_sift_down(heap, i - 1);
+    }
+    return ARRAY_OK;
+}
+
+// End heap ${heap.name}
+`
+}
+
 writeFileSync(output, outputText)
 
@@ -1,5 +1,18 @@
 #include "test.c"
 #include <stdio.h>
+#include <pthread.h>
+
+#define PRODUCERS 4
+#define PRODUCED 50
+
+static void *produce(void *arg) {
+	array_size_t_concurrent *concurrent = arg;
+	for (size_t i = 0; i < 25; i++) {
+		assert(array_size_t_concurrent_push(concurrent, i) == ARRAY_OK);
+	}
+	assert(ARRAY_SIZE_T_CONCURRENT_APPEND(concurrent, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48, 49) == ARRAY_OK);
+	return NULL;
+}
 
 int main(void) {
 	array_size_t arr = {0};
@@ -34,4 +47,66 @@ int main(void) {
 	}
     slice_size_t_delete_owned(slice);
     array_size_t_delete(arr);
+	puts("\n");
+
+	// Four producers fill the same array at once, each pushes 0..24 and appends 25..49
+	array_size_t_concurrent concurrent = {0};
+	assert(array_size_t_concurrent_init(&concurrent, 8) == ARRAY_OK);
+	pthread_t producers[PRODUCERS];
+	for (size_t i = 0; i < PRODUCERS; i++) {
+		assert(pthread_create(&producers[i], NULL, produce, &concurrent) == 0);
+	}
+	for (size_t i = 0; i < PRODUCERS; i++) {
+		assert(pthread_join(producers[i], NULL) == 0);
+	}
+	assert((uintptr_t)concurrent.segments[0] % 64 == 0);
+	assert(array_size_t_concurrent_seal(&concurrent, &slice) == ARRAY_OK);
+	// The order between threads is not fixed, but every value was stored once per producer
+	size_t seen[PRODUCED] = {0};
+	for (size_t i = 0; i < slice.len; i++) {
+		seen[slice_size_t_get(&slice, i)] += 1;
+	}
+	for (size_t i = 0; i < PRODUCED; i++) {
+		assert(seen[i] == PRODUCERS);
+	}
+	printf("%zu items from %d threads", slice.len, PRODUCERS);
+	slice_size_t_delete_owned(slice);
+	array_size_t_concurrent_delete(&concurrent);
+	puts("\n");
+
+	heap_size_t heap = {0};
+	assert(heap_size_t_heapify_from_slice(&heap, (slice_size_t){ .items = (size_t[]){ 5, 3, 9, 1 }, .len = 4 }) == ARRAY_OK);
+	assert(heap_size_t_push(&heap, 4) == ARRAY_OK);
+	while (heap_size_t_len(&heap) > 0) {
+		printf("%zu", heap_size_t_pop_top(&heap));
+	}
+	puts("\n");
+	heap_size_t_delete(heap);
+
+	// Large items are written and read in place, test.cgen aligns all items to 64 bytes
+	array_struct_record records = {0};
+	for (uint64_t i = 0; i < 20; i++) {
+		struct record *record = array_struct_record_emplace(&records);
+		assert(record != NULL);
+		assert((uintptr_t)records.items % 64 == 0);
+		record->id = i;
+		record->values[30] = (double)i / 2;
+	}
+	// _grow doubles the capacity in items: 4, 8, 16, 32
+	assert(records.len == 20 && records.cap == 32);
+	struct record replacement = { .id = 100 };
+	array_struct_record_set_ptr(&records, 3, &replacement);
+	for (size_t i = 0; i < records.len; i++) {
+		printf("%llu ", (unsigned long long)array_struct_record_get_ptr(&records, i)->id);
+	}
+	puts("\n");
+
+	slice_struct_record record_slice = {0};
+	assert(array_struct_record_to_owned_slice(&records, &record_slice) == ARRAY_OK);
+	assert((uintptr_t)record_slice.items % 64 == 0);
+	slice_struct_record_set_ptr(&record_slice, 0, &replacement);
+	assert(slice_struct_record_get_ptr(&record_slice, 0)->id == 100);
+	assert(slice_struct_record_get_ptr(&record_slice, 19)->values[30] == 9.5);
+	slice_struct_record_delete_owned(record_slice);
+	array_struct_record_delete(records);
 }